@@ -0,0 +1,204 @@
+/**
+ * ps2img - Create, inspect or extract Playstation 2 ROM image files
+ * Copyright (c) 2005 Damien Ciabrini (dciabrin), Olivier Parra (yo6)
+ *
+ *     ps2img is free software; you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as
+ *     published by the Free Software Foundation; either version 2 of
+ *     the License, or (at your option) any later version.
+ *
+ *     ps2img is distributed in the hope that it will be useful, but
+ *     WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public
+ *     License along with ps2img; if not, write to the Free Software
+ *     Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *     02111-1307 USA
+ *
+ * $Id$
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "common.h"
+
+extern void init_entry_from_irx( entry_t * entry, char *irx );
+extern void init_named_entry_from_irx( entry_t * entry, char *irx,
+                                       char *name );
+extern void verbose_print_add_message( const char *irx, int size );
+extern void verbose_print_delete_message( const char *irx, int size );
+
+
+/*---------------------------------------------------------------------*/
+/*    Transaction scripts:                                             */
+/*    -------------------------------------------------------------    */
+/*    A script lists operations to apply in order to a ROM image,      */
+/*    one per line. Blank lines and lines starting with # are          */
+/*    ignored.                                                         */
+/*      add IRX             append the IRX file to the image           */
+/*      delete NAME         remove entry NAME                          */
+/*      replace NAME IRX    replace the contents of entry NAME by      */
+/*                          the IRX file, keeping its name and place   */
+/*      rename NAME NEW     rename entry NAME to NEW                   */
+/*    All operations are applied to the list of entries in memory,     */
+/*    and the resulting image is written once.                         */
+/*---------------------------------------------------------------------*/
+
+typedef struct
+{
+  entry_t *entry;
+  int nb_entries;
+  int allocated;
+} entry_list_t;
+
+
+/*---------------------------------------------------------------------*/
+/*    find_user_entry ...                                              */
+/*    -------------------------------------------------------------    */
+/*    Find an IRX entry by name. The RESET, ROMDIR and EXTINFO         */
+/*    meta-entries are not eligible.                                   */
+/*---------------------------------------------------------------------*/
+static int find_user_entry( entry_list_t * l, char *name )
+{
+  int i;
+  for ( i = 3; i < l->nb_entries; i++ )
+    if ( strcmp( l->entry[i].name, name ) == 0 )
+      return i;
+  return -1;
+}
+
+
+static void check_entry_name( char *script, int line, entry_list_t * l,
+                              char *name )
+{
+  if ( strlen( name ) > 9 )
+    fatal( "%s:%d: invalid ROM file entry %s: name too long", script,
+           line, name );
+  if ( find_user_entry( l, name ) != -1 )
+    fatal( "%s:%d: entry %s already exists", script, line, name );
+}
+
+
+/*---------------------------------------------------------------------*/
+/*    apply_operation ...                                              */
+/*    -------------------------------------------------------------    */
+/*    Apply one line of a script to the list of entries.               */
+/*---------------------------------------------------------------------*/
+static void apply_operation( char *script, int line, entry_list_t * l,
+                             char *op, char *arg1, char *arg2 )
+{
+  time_t curtime = build_time(  );
+  entry_t entry;
+  int i;
+
+  if ( strcmp( op, "add" ) == 0 && arg1 && !arg2 ) {
+    init_entry_from_irx( &entry, arg1 );
+    check_entry_name( script, line, l, entry.name );
+    if ( reproducible )
+      entry.date = time_t_to_hexa( &curtime );
+    if ( l->nb_entries == l->allocated ) {
+      l->allocated *= 2;
+      if ( ( l->entry =
+             realloc( l->entry, l->allocated * sizeof( entry_t ) ) ) == NULL )
+        fatal_with_errno( "Cannot allocate memory" );
+    }
+    l->entry[l->nb_entries++] = entry;
+    if ( verbose )
+      verbose_print_add_message( entry.name, entry.irx_size );
+    return;
+  }
+
+  if ( !arg1 )
+    fatal( "%s:%d: invalid operation", script, line );
+  if ( ( i = find_user_entry( l, arg1 ) ) == -1 )
+    fatal( "%s:%d: entry %s not found", script, line, arg1 );
+
+  if ( strcmp( op, "delete" ) == 0 && !arg2 ) {
+    if ( verbose )
+      verbose_print_delete_message( l->entry[i].name, l->entry[i].irx_size );
+    memmove( &l->entry[i], &l->entry[i + 1],
+             ( l->nb_entries - i - 1 ) * sizeof( entry_t ) );
+    l->nb_entries--;
+  } else if ( strcmp( op, "replace" ) == 0 && arg2 ) {
+    init_named_entry_from_irx( &entry, arg2, l->entry[i].name );
+    if ( reproducible )
+      entry.date = time_t_to_hexa( &curtime );
+    l->entry[i] = entry;
+    if ( verbose ) {
+      printf( "Replacing " );
+      printf( name_format, entry.name );
+      printf( "(%d bytes)\n", entry.irx_size );
+    }
+  } else if ( strcmp( op, "rename" ) == 0 && arg2 ) {
+    check_entry_name( script, line, l, arg2 );
+    if ( verbose ) {
+      printf( "Renaming " );
+      printf( name_format, l->entry[i].name );
+      printf( "to %s\n", arg2 );
+    }
+    strcpy( l->entry[i].name, arg2 );
+  } else
+    fatal( "%s:%d: invalid operation", script, line );
+}
+
+
+/*---------------------------------------------------------------------*/
+/*    apply_script ...                                                 */
+/*    -------------------------------------------------------------    */
+/*    Apply a transaction script to an existing image, rewriting it    */
+/*    only once. The script is read on the standard input if its       */
+/*    name is `-'.                                                     */
+/*---------------------------------------------------------------------*/
+void apply_script( char *image_name, char *script )
+{
+  entry_list_t l;
+  char *img, *buf = NULL;
+  size_t buf_size = 0;
+  int size, compression, line = 0;
+  FILE *f;
+
+  // Read the entire file
+  image_lock( image_name );
+  read_file_compressed( image_name, &img, &size, &compression );
+
+  // Fill our entry descriptors
+  fill_entry_descriptors( image_name, img, size, &l.entry, &l.nb_entries );
+  l.allocated = l.nb_entries;
+
+  if ( strcmp( script, "-" ) == 0 )
+    f = stdin;
+  else if ( ( f = fopen( script, "r" ) ) == NULL )
+    fatal_with_errno( "Cannot open file %s", script );
+
+  while ( getline( &buf, &buf_size, f ) != -1 ) {
+    char *op, *arg1, *arg2, *save;
+    line++;
+    if ( ( op = strtok_r( buf, " \t\r\n", &save ) ) == NULL || op[0] == '#' )
+      continue;
+    arg1 = strtok_r( NULL, " \t\r\n", &save );
+    arg2 = arg1 ? strtok_r( NULL, " \t\r\n", &save ) : NULL;
+    if ( arg2 && strtok_r( NULL, " \t\r\n", &save ) )
+      fatal( "%s:%d: too many arguments", script, line );
+    apply_operation( script, line, &l, op, arg1, arg2 );
+  }
+  if ( ferror( f ) )
+    fatal_with_errno( "Cannot read file %s", script );
+  if ( f != stdin )
+    fclose( f );
+  free( buf );
+
+  if ( verbose ) {
+    printf( "Writing ROM image %s with the following entries:\n",
+            image_name );
+    verbose_display_header(  );
+  }
+
+  // done ! save the result to disk
+  write_image( image_name, l.entry, l.nb_entries,
+               image_compression( image_name, compression ) );
+  image_unlock(  );
+}
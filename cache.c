@@ -0,0 +1,335 @@
+/**
+ * ps2img - Create, inspect or extract Playstation 2 ROM image files
+ * Copyright (c) 2005 Damien Ciabrini (dciabrin), Olivier Parra (yo6)
+ *
+ *     ps2img is free software; you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as
+ *     published by the Free Software Foundation; either version 2 of
+ *     the License, or (at your option) any later version.
+ *
+ *     ps2img is distributed in the hope that it will be useful, but
+ *     WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public
+ *     License along with ps2img; if not, write to the Free Software
+ *     Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *     02111-1307 USA
+ *
+ * $Id$
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include "common.h"
+#include "sha256.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+
+/*---------------------------------------------------------------------*/
+/*    Image cache ...                                                  */
+/*    -------------------------------------------------------------    */
+/*    Created images can be kept in a cache directory, named after a   */
+/*    hash of everything that determines their contents: the ordered   */
+/*    IRXs, the meta-data of every ROMDIR entry and the compression    */
+/*    of the image. An image is stored as DIR/xx/xxxx..., xxxx...      */
+/*    being the hexadecimal hash, and is never modified afterwards.    */
+/*    The digest of its contents is kept next to it, in xxxx.sha256.   */
+/*    Note that unless --reproducible is used, the meta-data contain   */
+/*    the build time, so that cached images are seldom reused.         */
+/*---------------------------------------------------------------------*/
+#define CACHE_KEY_MAGIC "ps2img image cache 1"
+
+
+/*---------------------------------------------------------------------*/
+/*    image_cache_key ...                                              */
+/*    -------------------------------------------------------------    */
+/*    Compute the cache key of an image, given its entries.            */
+/*---------------------------------------------------------------------*/
+void image_cache_key( entry_t * entry, int nb_entries, int compression,
+                      unsigned char key[SHA256_SIZE] )
+{
+  unsigned char digest[SHA256_SIZE];
+  sha256_t ctx;
+  int i;
+
+  sha256_init( &ctx );
+  sha256_update( &ctx, CACHE_KEY_MAGIC, sizeof( CACHE_KEY_MAGIC ) );
+  sha256_update( &ctx, &compression, sizeof( compression ) );
+  sha256_update( &ctx, &nb_entries, sizeof( nb_entries ) );
+
+  for ( i = 0; i < nb_entries; i++ ) {
+    sha256_update( &ctx, entry[i].name, strlen( entry[i].name ) + 1 );
+    if ( entry[i].raw_extinfo ) {
+      // the records of an entry read from an image are written unchanged
+      sha256_update( &ctx, &entry[i].raw_extinfo_size,
+                     sizeof( entry[i].raw_extinfo_size ) );
+      sha256_update( &ctx, entry[i].raw_extinfo,
+                     entry[i].raw_extinfo_size );
+    } else {
+      sha256_update( &ctx, &entry[i].flags, sizeof( entry[i].flags ) );
+      if ( entry[i].flags & ENTRY_FLAG_DATE )
+        sha256_update( &ctx, &entry[i].date, sizeof( entry[i].date ) );
+      if ( entry[i].flags & ENTRY_FLAG_VERSION )
+        sha256_update( &ctx, &entry[i].version,
+                       sizeof( entry[i].version ) );
+      if ( entry[i].flags & ENTRY_FLAG_DESCR )
+        sha256_update( &ctx, entry[i].descr, strlen( entry[i].descr ) + 1 );
+    }
+    // the first three entries are the image's own meta-data
+    if ( i > 2 ) {
+      sha256_update( &ctx, &entry[i].irx_size, sizeof( entry[i].irx_size ) );
+      sha256_digest( entry[i].irx_binary, entry[i].irx_size, digest );
+      sha256_update( &ctx, digest, sizeof( digest ) );
+    }
+  }
+  sha256_final( &ctx, key );
+}
+
+
+/*---------------------------------------------------------------------*/
+/*    object_name ...                                                  */
+/*    -------------------------------------------------------------    */
+/*    The path of an object named after its hash in directory dir.     */
+/*    If subdir is not NULL, it receives the path of the directory     */
+/*    holding the object.                                              */
+/*---------------------------------------------------------------------*/
+char *object_name( const char *dir, const unsigned char key[SHA256_SIZE],
+                   char **subdir )
+{
+  char hex[SHA256_HEX_SIZE];
+  char *path;
+
+  sha256_to_hex( key, hex );
+  if ( ( path = malloc( strlen( dir ) + SHA256_HEX_SIZE + 2 ) ) == NULL )
+    fatal_with_errno( "Cannot allocate memory" );
+  sprintf( path, "%s/%.2s/%s", dir, hex, hex + 2 );
+  if ( subdir ) {
+    *subdir = strdup( path );
+    ( *subdir )[strlen( dir ) + 3] = '\0';
+  }
+  return path;
+}
+
+
+/*---------------------------------------------------------------------*/
+/*    open_temporary ...                                               */
+/*    -------------------------------------------------------------    */
+/*    Create a temporary file next to name, to be renamed over it      */
+/*    once complete. Its name is stored in res_tmp. Returns -1 on      */
+/*    failure.                                                         */
+/*---------------------------------------------------------------------*/
+static int open_temporary( const char *name, int mode, char **res_tmp )
+{
+  static unsigned counter;
+  char *tmp;
+  int fd;
+
+  if ( ( tmp = malloc( strlen( name ) + 32 ) ) == NULL )
+    fatal_with_errno( "Cannot allocate memory" );
+
+  // the name is unique among the threads and processes writing name
+  do
+    sprintf( tmp, "%s.%d.%u.tmp", name, ( int ) getpid(  ),
+             __sync_fetch_and_add( &counter, 1 ) );
+  while ( ( fd = open( tmp, O_WRONLY | O_CREAT | O_EXCL, mode ) ) == -1
+          && errno == EEXIST );
+  if ( fd == -1 ) {
+    free( tmp );
+    return -1;
+  }
+  *res_tmp = tmp;
+  return fd;
+}
+
+
+/*---------------------------------------------------------------------*/
+/*    clone_file ...                                                   */
+/*    -------------------------------------------------------------    */
+/*    Make the file out a copy of the file in, sharing its blocks      */
+/*    when the filesystem supports it (FICLONE), or else copying       */
+/*    the data. Returns 0 on failure.                                  */
+/*---------------------------------------------------------------------*/
+static int clone_file( int in, int out )
+{
+  char buf[0x10000];
+  ssize_t n;
+
+  if ( ioctl( out, FICLONE, in ) == 0 )
+    return 1;
+  if ( lseek( in, 0, SEEK_SET ) == -1 )
+    return 0;
+  while ( ( n = read( in, buf, sizeof( buf ) ) ) > 0 )
+    if ( write( out, buf, n ) != n )
+      return 0;
+  return n == 0;
+}
+
+
+/*---------------------------------------------------------------------*/
+/*    file_digest ...                                                  */
+/*    -------------------------------------------------------------    */
+/*    Compute the hexadecimal SHA-256 digest of the contents of the    */
+/*    opened file fd. Returns 0 on failure.                            */
+/*---------------------------------------------------------------------*/
+static int file_digest( int fd, char hex[SHA256_HEX_SIZE] )
+{
+  unsigned char digest[SHA256_SIZE];
+  char buf[0x10000];
+  sha256_t ctx;
+  ssize_t n;
+
+  if ( lseek( fd, 0, SEEK_SET ) == -1 )
+    return 0;
+  sha256_init( &ctx );
+  while ( ( n = read( fd, buf, sizeof( buf ) ) ) > 0 )
+    sha256_update( &ctx, buf, n );
+  if ( n == -1 )
+    return 0;
+  sha256_final( &ctx, digest );
+  sha256_to_hex( digest, hex );
+  return 1;
+}
+
+
+/*---------------------------------------------------------------------*/
+/*    digest_name ...                                                  */
+/*    -------------------------------------------------------------    */
+/*    Each cached image comes with a file holding the digest of its    */
+/*    contents. The key of an image only depends on what the image     */
+/*    is made of, so that the image is checked against this digest     */
+/*    before it is used.                                               */
+/*---------------------------------------------------------------------*/
+#define DIGEST_SUFFIX ".sha256"
+
+static char *digest_name( const char *object )
+{
+  char *name = malloc( strlen( object ) + sizeof( DIGEST_SUFFIX ) );
+  if ( name == NULL )
+    fatal_with_errno( "Cannot allocate memory" );
+  sprintf( name, "%s%s", object, DIGEST_SUFFIX );
+  return name;
+}
+
+
+/*---------------------------------------------------------------------*/
+/*    image_cache_fetch ...                                            */
+/*    -------------------------------------------------------------    */
+/*    Materialize a cached image as image_name, by reflink or, failing */
+/*    that, by copy. The image is never hardlinked to the cached one,  */
+/*    that is read-only and must not be updated with it. Returns 0 on  */
+/*    a cache miss, or when the cached image does not match its        */
+/*    digest.                                                          */
+/*---------------------------------------------------------------------*/
+int image_cache_fetch( const char *image_name,
+                       const unsigned char key[SHA256_SIZE] )
+{
+  char *object = object_name( cache_dir, key, NULL );
+  char *sum = digest_name( object );
+  char hex[SHA256_HEX_SIZE], expected[SHA256_HEX_SIZE];
+  char *tmp = NULL;
+  struct stat st;
+  int in, out, ok = 0;
+  FILE *f;
+
+  if ( ( in = open( object, O_RDONLY ) ) == -1 )
+    goto out;
+
+  if ( ( f = fopen( sum, "r" ) ) == NULL )
+    goto out;
+  if ( fread( expected, 1, SHA256_HEX_SIZE - 1, f ) != SHA256_HEX_SIZE - 1 )
+    expected[0] = '\0';
+  expected[SHA256_HEX_SIZE - 1] = '\0';
+  fclose( f );
+  if ( !file_digest( in, hex ) || strcmp( hex, expected ) != 0 ) {
+    warning( "Ignoring corrupted image %s in cache %s", object, cache_dir );
+    goto out;
+  }
+
+  // replace the image at once, so that it is never seen half-written
+  if ( ( out = open_temporary( image_name, 0666, &tmp ) ) == -1 )
+    goto out;
+  // like ostream_open_atomic, keep the permissions of the image
+  if ( stat( image_name, &st ) == 0 &&
+       fchmod( out, st.st_mode & 07777 ) == -1 )
+    close( out );
+  else if ( !clone_file( in, out ) )
+    close( out );
+  else
+    ok = close( out ) == 0 && rename( tmp, image_name ) == 0;
+  if ( !ok )
+    unlink( tmp );
+
+out:
+  if ( in != -1 )
+    close( in );
+  free( tmp );
+  free( sum );
+  free( object );
+  return ok;
+}
+
+
+/*---------------------------------------------------------------------*/
+/*    image_cache_store ...                                            */
+/*    -------------------------------------------------------------    */
+/*    Save a freshly created image into the cache. The image is        */
+/*    copied to a temporary file first and then renamed, so that       */
+/*    concurrent builds never see a partial image. Its digest is       */
+/*    published before it. A failure to store is not fatal.            */
+/*---------------------------------------------------------------------*/
+void image_cache_store( const char *image_name,
+                        const unsigned char key[SHA256_SIZE] )
+{
+  char *subdir;
+  char *object = object_name( cache_dir, key, &subdir );
+  char *sum = digest_name( object );
+  char hex[SHA256_HEX_SIZE];
+  char *tmp = NULL, *sum_tmp = NULL;
+  int in = -1, out, ok;
+
+  if ( ( mkdir( cache_dir, 0777 ) == -1 && errno != EEXIST ) ||
+       ( mkdir( subdir, 0777 ) == -1 && errno != EEXIST ) ||
+       ( in = open( image_name, O_RDONLY ) ) == -1 ||
+       ( out = open_temporary( object, 0444, &tmp ) ) == -1 )
+    goto failed;
+  ok = clone_file( in, out ) && file_digest( in, hex );
+  if ( close( out ) == -1 || !ok )
+    goto failed;
+
+  if ( ( out = open_temporary( sum, 0444, &sum_tmp ) ) == -1 )
+    goto failed;
+  hex[SHA256_HEX_SIZE - 1] = '\n';
+  ok = write( out, hex, SHA256_HEX_SIZE ) == SHA256_HEX_SIZE;
+  if ( close( out ) == -1 || !ok ||
+       rename( sum_tmp, sum ) == -1 || rename( tmp, object ) == -1 )
+    goto failed;
+  goto out;
+
+failed:
+  warning( "Cannot store %s in cache %s: %s", image_name, cache_dir,
+           strerror( errno ) );
+  if ( tmp )
+    unlink( tmp );
+  if ( sum_tmp )
+    unlink( sum_tmp );
+
+out:
+  if ( in != -1 )
+    close( in );
+  free( tmp );
+  free( sum_tmp );
+  free( sum );
+  free( subdir );
+  free( object );
+}
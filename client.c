@@ -0,0 +1,116 @@
+/**
+ * ps2img - Create, inspect or extract Playstation 2 ROM image files
+ * Copyright (c) 2005 Damien Ciabrini (dciabrin), Olivier Parra (yo6)
+ *
+ *     ps2img is free software; you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as
+ *     published by the Free Software Foundation; either version 2 of
+ *     the License, or (at your option) any later version.
+ *
+ *     ps2img is distributed in the hope that it will be useful, but
+ *     WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public
+ *     License along with ps2img; if not, write to the Free Software
+ *     Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *     02111-1307 USA
+ *
+ * $Id$
+ */
+
+/*---------------------------------------------------------------------*/
+/*    ps2img-client: send a command to a `ps2img --serve' server.      */
+/*    -------------------------------------------------------------    */
+/*    Usage: ps2img-client SOCKET [OPTION]... -f IMAGE [IRX]...        */
+/*    The options are the ones of ps2img. The output and the exit      */
+/*    status of the command are the ones of the server.                */
+/*---------------------------------------------------------------------*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+
+#include "serve.h"
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+
+static void client_fatal( char *msg, char *arg )
+{
+  fprintf( stderr, "ps2img-client: %s %s: %s\n", msg, arg,
+           strerror( errno ) );
+  exit( 1 );
+}
+
+int main( int argc, char *argv[] )
+{
+  struct sockaddr_un addr;
+  char cwd[4096];
+  char *req;
+  int size, i, s;
+
+  if ( argc < 2 ) {
+    fprintf( stderr, "Usage: ps2img-client SOCKET [OPTION]... "
+             "-f IMAGE [IRX]...\n" );
+    return 1;
+  }
+
+  // a server refusing the connection is reported, not a signal
+  signal( SIGPIPE, SIG_IGN );
+
+  if ( getcwd( cwd, sizeof( cwd ) ) == NULL )
+    client_fatal( "Cannot get current working directory", "" );
+
+  // build the request: working directory and arguments
+  size = strlen( cwd ) + 1;
+  for ( i = 2; i < argc; i++ )
+    size += strlen( argv[i] ) + 1;
+  if ( ( req = malloc( size ) ) == NULL )
+    client_fatal( "Cannot allocate memory", "" );
+  strcpy( req, cwd );
+  size = strlen( cwd ) + 1;
+  for ( i = 2; i < argc; i++ ) {
+    strcpy( req + size, argv[i] );
+    size += strlen( argv[i] ) + 1;
+  }
+
+  memset( &addr, 0, sizeof( addr ) );
+  addr.sun_family = AF_UNIX;
+  strncpy( addr.sun_path, argv[1], sizeof( addr.sun_path ) - 1 );
+  if ( ( s = socket( AF_UNIX, SOCK_STREAM, 0 ) ) == -1 )
+    client_fatal( "Cannot create socket", "" );
+  if ( connect( s, ( struct sockaddr * ) &addr, sizeof( addr ) ) == -1 )
+    client_fatal( "Cannot connect to", argv[1] );
+  if ( !frame_write( s, FRAME_REQUEST, req, size ) )
+    client_fatal( "Cannot send request to", argv[1] );
+
+  for ( ;; ) {
+    int type;
+    char *data;
+    if ( !frame_read( s, &type, &data, &size ) ) {
+      fprintf( stderr, "ps2img-client: connection to %s lost\n", argv[1] );
+      return 1;
+    }
+    switch ( type ) {
+    case FRAME_STDOUT:
+      fwrite( data, 1, size, stdout );
+      break;
+    case FRAME_STDERR:
+      fwrite( data, 1, size, stderr );
+      break;
+    case FRAME_STATUS:
+      if ( size != 4 )
+        return 1;
+      return ( ( unsigned char ) data[0] << 24 ) |
+        ( ( unsigned char ) data[1] << 16 ) |
+        ( ( unsigned char ) data[2] << 8 ) | ( unsigned char ) data[3];
+    }
+    free( data );
+  }
+}
@@ -21,26 +21,215 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdarg.h>
 #include <errno.h>
 #include <string.h>
+#include <stddef.h>
+#include <zlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/file.h>
 #include "common.h"
 
 char name_format[] = "%-4s ";
 char size_format[] = "%4d ";
 char header_format[] = "NAME      DATE     VER %4s DESCRIPTION";
 
+// When set, fatal errors unwind to this point instead of exiting
+jmp_buf *fatal_recovery;
+
+// Image locked by the current thread, if any
+static __thread int image_lock_fd = -1;
+
 
 /*---------------------------------------------------------------------*/
-/*    read_file ...                                                    */
+/*    Cleanups ...                                                     */
 /*    -------------------------------------------------------------    */
-/*    Read and store the contents of a file in memory.                 */
+/*    Resources held by the current thread that a fatal error must     */
+/*    release before unwinding to fatal_recovery, so that resident     */
+/*    processes do not leak what a failed command held. They are       */
+/*    pushed and popped like a stack, and all run on a fatal error:    */
+/*    a recovery point must not be set while cleanups are pending.     */
 /*---------------------------------------------------------------------*/
-void read_file( char *irx, char **data, int *size )
+#define MAX_CLEANUPS 32
+
+typedef struct
+{
+  void ( *fn ) ( void * );
+  void *arg;
+} cleanup_t;
+
+static __thread cleanup_t cleanups[MAX_CLEANUPS];
+static __thread int nb_cleanups;
+
+void cleanup_push( void ( *fn ) ( void * ), void *arg )
+{
+  if ( nb_cleanups == MAX_CLEANUPS )
+    fatal( "Too many pending cleanups" );
+  cleanups[nb_cleanups].fn = fn;
+  cleanups[nb_cleanups].arg = arg;
+  nb_cleanups++;
+}
+
+void cleanup_pop( int run )
+{
+  nb_cleanups--;
+  if ( run )
+    cleanups[nb_cleanups].fn( cleanups[nb_cleanups].arg );
+}
+
+static void run_cleanups( void )
+{
+  while ( nb_cleanups > 0 )
+    cleanup_pop( 1 );
+}
+
+// Release a buffer given the address of the pointer to it
+void free_indirect( void *p )
+{
+  free( *( void ** ) p );
+}
+
+static void close_file( void *f )
+{
+  fclose( f );
+}
+
+static void end_inflate( void *z )
+{
+  inflateEnd( z );
+}
+
+
+/*---------------------------------------------------------------------*/
+/*    Compressed streams ...                                           */
+/*    -------------------------------------------------------------    */
+/*    Images may be stored as zlib or gzip streams. They are           */
+/*    inflated while being read, and deflated while being written,     */
+/*    so that no temporary uncompressed file is ever needed.           */
+/*---------------------------------------------------------------------*/
+#define STREAM_CHUNK 0x10000
+
+struct ostream
 {
   FILE *f;
+  const char *name;
+  char *tmp_name;
+  int compression;
+  z_stream z;
+  // bytes of in handed out by ostream_reserve, not written yet
+  int buffered;
+  unsigned char out[STREAM_CHUNK];
+  unsigned char in[STREAM_CHUNK];
+};
+
+
+/*---------------------------------------------------------------------*/
+/*    detect_compression ...                                           */
+/*    -------------------------------------------------------------    */
+/*    Guess the format of a file from its first two bytes.             */
+/*---------------------------------------------------------------------*/
+static int detect_compression( const unsigned char *magic )
+{
+  if ( magic[0] == 0x1F && magic[1] == 0x8B )
+    return COMPRESS_GZIP;
+  // zlib header: deflate method, and a 16 bits checksum multiple of 31
+  if ( ( magic[0] & 0xF ) == 8 && ( ( magic[0] << 8 ) | magic[1] ) % 31 == 0 )
+    return COMPRESS_ZLIB;
+  return COMPRESS_NONE;
+}
+
+
+/*---------------------------------------------------------------------*/
+/*    inflate_file ...                                                 */
+/*    -------------------------------------------------------------    */
+/*    Inflate a compressed file into memory, chunk by chunk.           */
+/*---------------------------------------------------------------------*/
+static void inflate_file( char *file, FILE * f, int compression,
+                          char **data, int *size )
+{
+  unsigned char in[STREAM_CHUNK];
+  z_stream z;
+  int allocated = 4 * STREAM_CHUNK;
+  int ret = Z_OK;
+
+  memset( &z, 0, sizeof( z ) );
+  if ( inflateInit2( &z, compression == COMPRESS_GZIP ? 15 + 16 : 15 ) !=
+       Z_OK )
+    fatal( "Cannot initialize decompression of file %s", file );
+
+  cleanup_push( end_inflate, &z );
+  if ( ( *data = malloc( allocated ) ) == NULL )
+    fatal_with_errno( "Cannot allocate %d bytes for loading file %s",
+                      allocated, file );
+  cleanup_push( free_indirect, data );
+  *size = 0;
+
+  while ( ret != Z_STREAM_END ) {
+    if ( z.avail_in == 0 ) {
+      z.avail_in = fread( in, 1, sizeof( in ), f );
+      z.next_in = in;
+      if ( z.avail_in == 0 ) {
+        if ( ferror( f ) )
+          fatal_with_errno( "Cannot read file %s", file );
+        fatal( "Cannot read file %s: truncated compressed stream", file );
+      }
+    }
+    if ( *size == allocated ) {
+      if ( allocated > 0x3FFFFFFF )
+        fatal( "Cannot load file %s: too large once decompressed", file );
+      allocated *= 2;
+      if ( ( *data = realloc( *data, allocated ) ) == NULL )
+        fatal_with_errno( "Cannot allocate %d bytes for loading file %s",
+                          allocated, file );
+    }
+    z.next_out = ( unsigned char * ) *data + *size;
+    z.avail_out = allocated - *size;
+    ret = inflate( &z, Z_NO_FLUSH );
+    if ( ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR )
+      fatal( "Cannot decompress file %s: %s", file,
+             z.msg ? z.msg : "corrupted stream" );
+    *size = allocated - z.avail_out;
+  }
+  cleanup_pop( 0 );
+  cleanup_pop( 1 );
+}
+
+
+/*---------------------------------------------------------------------*/
+/*    read_file_compressed ...                                         */
+/*    -------------------------------------------------------------    */
+/*    Read and store the contents of a file in memory, decompressing   */
+/*    it if needed. The format of the file is returned in              */
+/*    compression, if not NULL.                                        */
+/*---------------------------------------------------------------------*/
+void read_file_compressed( char *irx, char **data, int *size,
+                           int *compression )
+{
+  FILE *f;
+  unsigned char magic[2];
+  int format = COMPRESS_NONE;
+
+  TRACE_BEGIN( "read_file", irx );
   if ( ( f = fopen( irx, "r" ) ) == NULL )
     fatal_with_errno( "Cannot open file %s", irx );
+  cleanup_push( close_file, f );
+
+  if ( fread( magic, 1, sizeof( magic ), f ) == sizeof( magic ) )
+    format = detect_compression( magic );
+  if ( compression )
+    *compression = format;
+
+  if ( fseek( f, 0, SEEK_SET ) == -1 )
+    fatal_with_errno( "Cannot seek in file %s", irx );
+
+  if ( format != COMPRESS_NONE ) {
+    inflate_file( irx, f, format, data, size );
+    cleanup_pop( 1 );
+    TRACE_END( "read_file" );
+    return;
+  }
 
   if ( fseek( f, 0, SEEK_END ) == -1 )
     fatal_with_errno( "Cannot seek in file %s", irx );
@@ -51,6 +240,7 @@ void read_file( char *irx, char **data, int *size )
   if ( ( *data = malloc( *size ) ) == NULL )
     fatal_with_errno( "Cannot allocate %d bytes for loading file %s",
                       *size, irx );
+  cleanup_push( free_indirect, data );
 
   if ( fseek( f, 0, SEEK_SET ) == -1 )
     fatal_with_errno( "Cannot seek in file %s", irx );
@@ -58,8 +248,370 @@ void read_file( char *irx, char **data, int *size )
   if ( fread( *data, *size, 1, f ) != 1 )
     fatal_with_errno( "Cannot read file %s", irx );
 
+  cleanup_pop( 0 );
+  cleanup_pop( 0 );
   if ( fclose( f ) == -1 )
     fatal_with_errno( "Cannot close file %s", irx );
+  TRACE_END( "read_file" );
+}
+
+
+/*---------------------------------------------------------------------*/
+/*    read_file ...                                                    */
+/*    -------------------------------------------------------------    */
+/*    Read and store the contents of a file in memory.                 */
+/*---------------------------------------------------------------------*/
+void read_file( char *irx, char **data, int *size )
+{
+  read_file_compressed( irx, data, size, NULL );
+}
+
+
+/*---------------------------------------------------------------------*/
+/*    ostream_init ...                                                 */
+/*    -------------------------------------------------------------    */
+/*    Set up a stream around an opened file. Until it is closed, a     */
+/*    fatal error discards the stream and its temporary file.          */
+/*---------------------------------------------------------------------*/
+static void ostream_discard( void *p )
+{
+  ostream_t *o = p;
+  if ( o->compression != COMPRESS_NONE )
+    deflateEnd( &o->z );
+  if ( o->f )
+    fclose( o->f );
+  if ( o->tmp_name ) {
+    unlink( o->tmp_name );
+    free( o->tmp_name );
+  }
+  free( o );
+}
+
+static ostream_t *ostream_init( FILE * f, const char *name, char *tmp_name,
+                                int compression )
+{
+  ostream_t *o;
+  if ( ( o = malloc( sizeof( ostream_t ) ) ) == NULL )
+    fatal_with_errno( "Cannot allocate memory for writing file %s", name );
+  memset( o, 0, offsetof( ostream_t, out ) );
+  o->f = f;
+  o->name = name;
+  o->tmp_name = tmp_name;
+  o->compression = compression;
+  cleanup_push( ostream_discard, o );
+
+  if ( compression != COMPRESS_NONE &&
+       deflateInit2( &o->z, Z_BEST_COMPRESSION, Z_DEFLATED,
+                     compression == COMPRESS_GZIP ? 15 + 16 : 15, 9,
+                     Z_DEFAULT_STRATEGY ) != Z_OK )
+    fatal( "Cannot initialize compression of file %s", name );
+  return o;
+}
+
+
+/*---------------------------------------------------------------------*/
+/*    ostream_open_atomic ...                                          */
+/*    -------------------------------------------------------------    */
+/*    Create a file to be written sequentially, compressed or not.     */
+/*    The data go to a temporary file that only replaces the file      */
+/*    when the stream is closed, so that readers never see a partial   */
+/*    file. The file keeps its permissions if it already exists.       */
+/*---------------------------------------------------------------------*/
+ostream_t *ostream_open_atomic( const char *name, int compression )
+{
+  static unsigned counter;
+  struct stat st;
+  char *tmp_name;
+  int fd;
+  FILE *f;
+
+  if ( ( tmp_name = malloc( strlen( name ) + 32 ) ) == NULL )
+    fatal_with_errno( "Cannot allocate memory for writing file %s", name );
+
+  // the name is unique among the threads and processes writing name
+  do
+    sprintf( tmp_name, "%s.%d.%u.tmp", name, ( int ) getpid(  ),
+             __sync_fetch_and_add( &counter, 1 ) );
+  while ( ( fd = open( tmp_name, O_WRONLY | O_CREAT | O_EXCL, 0666 ) ) == -1
+          && errno == EEXIST );
+  if ( fd == -1 )
+    fatal_with_errno( "Cannot create temporary file for %s", name );
+
+  if ( ( stat( name, &st ) == 0 && fchmod( fd, st.st_mode & 07777 ) == -1 ) ||
+       ( f = fdopen( fd, "w" ) ) == NULL ) {
+    close( fd );
+    unlink( tmp_name );
+    fatal_with_errno( "Cannot create temporary file for %s", name );
+  }
+  return ostream_init( f, name, tmp_name, compression );
+}
+
+
+/*---------------------------------------------------------------------*/
+/*    ostream_open_memory ...                                          */
+/*    -------------------------------------------------------------    */
+/*    Create a stream that writes to memory, compressed or not. Once   */
+/*    the stream is closed, data and size hold what was written.       */
+/*    name is only used in error messages.                             */
+/*---------------------------------------------------------------------*/
+ostream_t *ostream_open_memory( const char *name, char **data, size_t *size,
+                                int compression )
+{
+  FILE *f;
+
+  if ( ( f = open_memstream( data, size ) ) == NULL )
+    fatal_with_errno( "Cannot allocate memory for writing %s", name );
+  return ostream_init( f, name, NULL, compression );
+}
+
+
+/*---------------------------------------------------------------------*/
+/*    image_lock ...                                                   */
+/*    -------------------------------------------------------------    */
+/*    Take the writer lock of an image before reading it for update.   */
+/*    Writers never modify an image in place but publish a new file    */
+/*    over it, so readers need no lock and never wait for a writer.    */
+/*    The lock only serializes the writers, which would otherwise      */
+/*    lose each other's updates. Since a writer replaces the file,     */
+/*    the lock is retried until it is held on the current file. An     */
+/*    image that does not exist yet is not locked.                     */
+/*---------------------------------------------------------------------*/
+void image_lock( const char *name )
+{
+  struct stat st, locked;
+  int fd;
+
+  for ( ;; ) {
+    if ( ( fd = open( name, O_RDONLY ) ) == -1 ) {
+      if ( errno == ENOENT )
+        return;
+      fatal_with_errno( "Cannot open file %s", name );
+    }
+    image_lock_fd = fd;
+    if ( flock( fd, LOCK_EX ) == -1 )
+      fatal_with_errno( "Cannot lock file %s", name );
+    if ( fstat( fd, &locked ) == 0 && stat( name, &st ) == 0 &&
+         st.st_dev == locked.st_dev && st.st_ino == locked.st_ino )
+      return;
+    image_unlock(  );
+  }
+}
+
+void image_unlock( void )
+{
+  if ( image_lock_fd != -1 ) {
+    close( image_lock_fd );
+    image_lock_fd = -1;
+  }
+}
+
+
+/*---------------------------------------------------------------------*/
+/*    ostream_deflate ...                                              */
+/*    -------------------------------------------------------------    */
+/*    Feed the compressor and flush its output to disk.                */
+/*---------------------------------------------------------------------*/
+static void ostream_deflate( ostream_t * o, int flush )
+{
+  int ret;
+  do {
+    o->z.next_out = o->out;
+    o->z.avail_out = sizeof( o->out );
+    ret = deflate( &o->z, flush );
+    if ( ret == Z_STREAM_ERROR )
+      fatal( "Cannot compress file %s", o->name );
+    int n = sizeof( o->out ) - o->z.avail_out;
+    if ( n && fwrite( o->out, n, 1, o->f ) != 1 )
+      fatal_with_errno( "Cannot write to file %s", o->name );
+  } while ( o->z.avail_out == 0 );
+}
+
+static void ostream_put( ostream_t * o, const void *data, int size )
+{
+  if ( size == 0 )
+    return;
+
+  if ( o->compression == COMPRESS_NONE ) {
+    if ( fwrite( data, size, 1, o->f ) != 1 )
+      fatal_with_errno( "Cannot write to file %s", o->name );
+    return;
+  }
+
+  o->z.next_in = ( unsigned char * ) data;
+  o->z.avail_in = size;
+  ostream_deflate( o, Z_NO_FLUSH );
+}
+
+static void ostream_flush( ostream_t * o )
+{
+  ostream_put( o, o->in, o->buffered );
+  o->buffered = 0;
+}
+
+void ostream_write( ostream_t * o, const void *data, int size )
+{
+  if ( o->buffered )
+    ostream_flush( o );
+  ostream_put( o, data, size );
+}
+
+
+/*---------------------------------------------------------------------*/
+/*    ostream_reserve ...                                              */
+/*    -------------------------------------------------------------    */
+/*    Hand out room for size bytes, at most STREAM_CHUNK, in the       */
+/*    buffer of the stream, so that they can be built in place.        */
+/*    ostream_commit then appends the bytes actually built to the      */
+/*    stream. Small pieces of data are thus written without being      */
+/*    gathered in a buffer of their own first.                         */
+/*---------------------------------------------------------------------*/
+void *ostream_reserve( ostream_t * o, int size )
+{
+  if ( size > STREAM_CHUNK - o->buffered )
+    ostream_flush( o );
+  return o->in + o->buffered;
+}
+
+void ostream_commit( ostream_t * o, int size )
+{
+  o->buffered += size;
+}
+
+void ostream_close( ostream_t * o )
+{
+  if ( o->buffered )
+    ostream_flush( o );
+  if ( o->compression != COMPRESS_NONE ) {
+    ostream_deflate( o, Z_FINISH );
+    deflateEnd( &o->z );
+  }
+
+  int closed = fclose( o->f );
+  o->f = NULL;
+  if ( closed == -1 )
+    fatal_with_errno( "Cannot close file %s", o->name );
+
+  if ( o->tmp_name ) {
+    if ( rename( o->tmp_name, o->name ) == -1 ) {
+      unlink( o->tmp_name );
+      fatal_with_errno( "Cannot replace file %s", o->name );
+    }
+    free( o->tmp_name );
+  }
+  cleanup_pop( 0 );
+  free( o );
+}
+
+
+/*---------------------------------------------------------------------*/
+/*    write_file_compressed ...                                        */
+/*    -------------------------------------------------------------    */
+/*    Store a block of memory to a file, compressed or not.            */
+/*---------------------------------------------------------------------*/
+void write_file_compressed( const char *irx, unsigned char *data, int size,
+                            int compression )
+{
+  TRACE_BEGIN( "write_file", irx );
+  ostream_t *o = ostream_open_atomic( irx, compression );
+  ostream_write( o, data, size );
+  ostream_close( o );
+  TRACE_END( "write_file" );
+}
+
+
+/*---------------------------------------------------------------------*/
+/*    write_file ...                                                   */
+/*    -------------------------------------------------------------    */
+/*    Store a block of memory to a file.                               */
+/*---------------------------------------------------------------------*/
+void write_file( const char *irx, unsigned char *data, int size )
+{
+  write_file_compressed( irx, data, size, COMPRESS_NONE );
+}
+
+
+/*---------------------------------------------------------------------*/
+/*    buffer_put ...                                                   */
+/*    -------------------------------------------------------------    */
+/*    Append data to a growable buffer.                                */
+/*---------------------------------------------------------------------*/
+void buffer_put( buffer_t * b, const void *data, int size )
+{
+  if ( b->size + size > b->allocated ) {
+    while ( b->size + size > b->allocated )
+      b->allocated = b->allocated ? b->allocated * 2 : 0x10000;
+    if ( ( b->data = realloc( b->data, b->allocated ) ) == NULL )
+      fatal_with_errno( "Cannot allocate %d bytes of memory", b->allocated );
+  }
+  memcpy( b->data + b->size, data, size );
+  b->size += size;
+}
+
+void buffer_put_byte( buffer_t * b, int value )
+{
+  unsigned char v = value;
+  buffer_put( b, &v, 1 );
+}
+
+void buffer_put_int( buffer_t * b, int value )
+{
+  unsigned char v[4];
+  v[0] = value;
+  v[1] = value >> 8;
+  v[2] = value >> 16;
+  v[3] = value >> 24;
+  buffer_put( b, v, sizeof( v ) );
+}
+
+void buffer_put_int64( buffer_t * b, long long value )
+{
+  buffer_put_int( b, value );
+  buffer_put_int( b, value >> 32 );
+}
+
+
+/*---------------------------------------------------------------------*/
+/*    reader_get ...                                                   */
+/*    -------------------------------------------------------------    */
+/*    Consume data from a reader, failing if they are truncated.       */
+/*---------------------------------------------------------------------*/
+unsigned char *reader_get( reader_t * r, int size )
+{
+  unsigned char *data = r->data + r->off;
+  if ( size < 0 || size > r->size - r->off )
+    fatal( "%s is truncated or corrupted", r->name );
+  r->off += size;
+  return data;
+}
+
+int reader_get_int( reader_t * r )
+{
+  unsigned char *v = reader_get( r, 4 );
+  return v[0] | ( v[1] << 8 ) | ( v[2] << 16 ) | ( ( unsigned ) v[3] << 24 );
+}
+
+long long reader_get_int64( reader_t * r )
+{
+  long long low = ( unsigned ) reader_get_int( r );
+  return low | ( ( long long ) reader_get_int( r ) << 32 );
+}
+
+
+/*---------------------------------------------------------------------*/
+/*    image_compression ...                                            */
+/*    -------------------------------------------------------------    */
+/*    Choose the format in which an image is saved: gzip if asked      */
+/*    to or if its name ends with .gz, otherwise the format it had     */
+/*    when it was read.                                                */
+/*---------------------------------------------------------------------*/
+int image_compression( const char *image_name, int detected )
+{
+  int len = strlen( image_name );
+  if ( compress_image )
+    return COMPRESS_GZIP;
+  if ( len > 3 && strcmp( image_name + len - 3, ".gz" ) == 0 )
+    return COMPRESS_GZIP;
+  return detected;
 }
 
 
@@ -125,24 +677,142 @@ void verbose_dump_entry_info( entry_t * e )
   printf( size_format, e->irx_size );
 
   if ( e->flags & ENTRY_FLAG_DESCR )
-    printf( "%s\n", e->descr );
+    printf( "%s\n", entry_descr( e ) );
   else
     printf( "-\n" );
 }
 
 
+/*---------------------------------------------------------------------*/
+/*    build_time ...                                                   */
+/*    -------------------------------------------------------------    */
+/*    The time stamped into the images being built: the current       */
+/*    time, or for reproducible builds $SOURCE_DATE_EPOCH (or the      */
+/*    epoch when it is not set).                                       */
+/*---------------------------------------------------------------------*/
+time_t build_time(  )
+{
+  char *epoch, *end;
+  long long t;
+
+  if ( !reproducible )
+    return time( NULL );
+
+  if ( ( epoch = getenv( "SOURCE_DATE_EPOCH" ) ) == NULL || !*epoch )
+    return 0;
+  errno = 0;
+  t = strtoll( epoch, &end, 10 );
+  if ( errno || *end || t < 0 )
+    fatal( "Invalid SOURCE_DATE_EPOCH value %s", epoch );
+  return t;
+}
+
+
+/*---------------------------------------------------------------------*/
+/*    time_to_tm ...                                                   */
+/*    -------------------------------------------------------------    */
+/*    Break down a time, in UTC for reproducible builds so that the    */
+/*    result does not depend on the timezone of the build host.        */
+/*---------------------------------------------------------------------*/
+void time_to_tm( time_t * time, struct tm *m )
+{
+  if ( reproducible )
+    gmtime_r( time, m );
+  else
+    localtime_r( time, m );
+}
+
+
 int time_t_to_hexa( time_t * time )
 {
   char conv[11];
   int date_hexa;
   struct tm m;
-  localtime_r( time, &m );
+  time_to_tm( time, &m );
   snprintf( conv, sizeof( conv ), "0x%04d%02d%02d",
             m.tm_year + 1900, m.tm_mon + 1, m.tm_mday );
   sscanf( conv, "%x", &date_hexa );
   return date_hexa;
 }
 
+
+/*---------------------------------------------------------------------*/
+/*    parse_iopmod_section ...                                         */
+/*    -------------------------------------------------------------    */
+/*    Extract the version and the description of an IRX from the       */
+/*    raw contents of its .iopmod section. Returns 0 when the section  */
+/*    is too short to hold them.                                       */
+/*---------------------------------------------------------------------*/
+int parse_iopmod_section( const char *iopmodsec, int size,
+                          unsigned short *version, char *descr,
+                          int descr_size )
+{
+  const unsigned char *sec = ( const unsigned char * ) iopmodsec;
+  int len;
+
+  if ( size <= IOPMOD_DESCR_OFFSET )
+    return 0;
+
+  *version = ( sec[IOPMOD_VERSION_OFFSET] << 8 ) +
+    sec[IOPMOD_VERSION_OFFSET + 1];
+
+  // the description may not be terminated within the section
+  len = strnlen( iopmodsec + IOPMOD_DESCR_OFFSET,
+                 size - IOPMOD_DESCR_OFFSET );
+  if ( len >= descr_size )
+    len = descr_size - 1;
+  memcpy( descr, iopmodsec + IOPMOD_DESCR_OFFSET, len );
+  descr[len] = '\0';
+  return 1;
+}
+
+
+
+/*---------------------------------------------------------------------*/
+/*    iopmod_section_index ...                                         */
+/*    -------------------------------------------------------------    */
+/*    Return the index of the .iopmod section among the shnum          */
+/*    section headers esh, whose names are in strtab, or -1.           */
+/*---------------------------------------------------------------------*/
+int iopmod_section_index( const Elf32_Shdr * esh, int shnum,
+                          const char *strtab, int strtab_size )
+{
+  int i;
+
+  // don't search in the first section descriptor as it is a dummy
+  for ( i = 1; i < shnum; i++ )
+    // the whole name, terminator included, must lie within the table
+    if ( esh[i].sh_name < strtab_size &&
+         strtab_size - esh[i].sh_name >= sizeof( ".iopmod" ) &&
+         strcmp( strtab + esh[i].sh_name, ".iopmod" ) == 0 )
+      return i;
+  return -1;
+}
+
+void warning( char *format, ... )
+{
+  va_list ap;
+  fprintf( stderr, "%s: ", program_name );
+  va_start( ap, format );
+  vfprintf( stderr, format, ap );
+  va_end( ap );
+  fprintf( stderr, "\n" );
+}
+
+/*---------------------------------------------------------------------*/
+/*    recover ...                                                      */
+/*    -------------------------------------------------------------    */
+/*    Release what the failed operation held, and unwind to the        */
+/*    recovery point of the resident process.                          */
+/*---------------------------------------------------------------------*/
+static void recover( void )
+{
+  run_cleanups(  );
+  TRACE_UNWIND(  );
+  image_unlock(  );
+  longjmp( *fatal_recovery, 1 );
+}
+
 void fatal( char *format, ... )
 {
   va_list ap;
@@ -151,6 +821,8 @@ void fatal( char *format, ... )
   vfprintf( stderr, format, ap );
   va_end( ap );
   fprintf( stderr, "\n" );
+  if ( fatal_recovery )
+    recover(  );
   exit( 1 );
 }
 
@@ -162,5 +834,7 @@ void fatal_with_errno( char *format, ... )
   vfprintf( stderr, format, ap );
   va_end( ap );
   fprintf( stderr, ": %s\n", strerror( errno ) );
+  if ( fatal_recovery )
+    recover(  );
   exit( 1 );
 }
@@ -24,6 +24,11 @@
 #define __COMMON_H__
 
 #include <time.h>
+#include <setjmp.h>
+#include <sys/stat.h>
+#include "sha256.h"
+#include "elf.h"
+#include "trace.h"
 
 
 
@@ -33,6 +38,14 @@
 
 extern char *program_name;
 extern int verbose;
+extern int compress_image;
+extern int build_index;
+extern int reproducible;
+extern char *romdir_descr;
+extern char *cache_dir;
+extern char *store_dir;
+extern int strip_irxs;
+extern jmp_buf *fatal_recovery;
 /*---------------------------------------------------------------------*/
 /*    ROM image layout:                                                */
 /*    -------------------------------------------------------------    */
@@ -71,6 +84,9 @@ typedef struct
 #define EXTINFO_ID_DESCR    3
 #define EXTINFO_ID_NULL     0x7F
 
+// the size of a record is a byte: longer descriptions are truncated
+#define EXTINFO_DESCR_MAX   252
+
 
 /*---------------------------------------------------------------------*/
 /*    The IRX entry structure ...                                      */
@@ -82,8 +98,15 @@ typedef struct
   unsigned date;
   unsigned short version;
   char descr[256];
+  // the description of an entry read from an image, in its EXTINFO
+  // records, or NULL if it is in descr
+  const char *descr_view;
   int irx_size;
+  int irx_offset;
   char *irx_binary;
+  // raw EXTINFO records of an entry read from an image, or NULL
+  char *raw_extinfo;
+  int raw_extinfo_size;
 } entry_t;
 
 #define ENTRY_FLAG_DATE     0x1
@@ -91,6 +114,60 @@ typedef struct
 #define ENTRY_FLAG_DESCR    0x4
 #define ENTRY_FLAG_NULL     0x8
 
+static inline const char *entry_descr( const entry_t * entry )
+{
+  return entry->descr_view ? entry->descr_view : entry->descr;
+}
+
+
+/*---------------------------------------------------------------------*/
+/*    The .iopmod section of an IRX ...                                */
+/*    -------------------------------------------------------------    */
+/*    The first 24 bytes of the section contain:                       */
+/*      [4 bytes] a magic word                                         */
+/*      [4 bytes] the IRX's start address                              */
+/*      [4 bytes] the value of the GP register                         */
+/*      [4 bytes] the size of the .text section                        */
+/*      [4 bytes] the size of the .data section                        */
+/*      [4 bytes] the size of the .bss section                         */
+/*    They are followed by the IRX version and its description.        */
+/*---------------------------------------------------------------------*/
+#define IOPMOD_VERSION_OFFSET 24
+#define IOPMOD_DESCR_OFFSET   26
+
+
+
+/*---------------------------------------------------------------------*/
+/*    Compressed files ...                                             */
+/*---------------------------------------------------------------------*/
+#define COMPRESS_NONE 0
+#define COMPRESS_GZIP 1
+#define COMPRESS_ZLIB 2
+
+typedef struct ostream ostream_t;
+
+
+/*---------------------------------------------------------------------*/
+/*    Serialized data ...                                              */
+/*    -------------------------------------------------------------    */
+/*    Patches and packs are built in growable buffers and decoded      */
+/*    with bounds-checked readers. Integers are little endian.         */
+/*---------------------------------------------------------------------*/
+typedef struct
+{
+  unsigned char *data;
+  int size;
+  int allocated;
+} buffer_t;
+
+typedef struct
+{
+  const char *name;
+  unsigned char *data;
+  int size;
+  int off;
+} reader_t;
+
 
 
 extern char name_format[];
@@ -98,14 +175,79 @@ extern char size_format[];
 
 
 
+void reset_options ();
 void read_file (char *irx, char **data, int *size);
+void read_file_compressed (char *irx, char **data, int *size,
+                           int *compression);
+void write_file (const char *irx, unsigned char *data, int size);
+void write_file_compressed (const char *irx, unsigned char *data, int size,
+                            int compression);
+int image_compression (const char *image_name, int detected);
+ostream_t *ostream_open_atomic (const char *name, int compression);
+ostream_t *ostream_open_memory (const char *name, char **data, size_t *size,
+                                int compression);
+void ostream_write (ostream_t * o, const void *data, int size);
+void *ostream_reserve (ostream_t * o, int size);
+void ostream_commit (ostream_t * o, int size);
+void ostream_close (ostream_t * o);
+void buffer_put (buffer_t * b, const void *data, int size);
+void buffer_put_byte (buffer_t * b, int value);
+void buffer_put_int (buffer_t * b, int value);
+void buffer_put_int64 (buffer_t * b, long long value);
+unsigned char *reader_get (reader_t * r, int size);
+int reader_get_int (reader_t * r);
+long long reader_get_int64 (reader_t * r);
+void image_lock (const char *name);
+void image_unlock (void);
+char *strip_irx (char *irx, char *elf, int *size);
+int extinfo_size (entry_t * entry);
+int extinfo_encode (entry_t * entry, char *out);
+int extinfo_decode (entry_t * entry, char *extinfo, int size);
+void write_image (char *image_name, entry_t * entry, int nb_entries,
+                  int compression);
+void fill_entry_descriptors (char *image_file, char *img, int img_size,
+                             entry_t ** res_entries, int *res_nb_entries);
+void irx_cache_enable ();
+int irx_cache_lookup (const char *irx, struct stat *st, entry_t * entry);
+void irx_cache_store (const char *irx, struct stat *st, entry_t * entry);
+int irx_cache_lookup_stripped (const char *irx, entry_t * entry);
+int irx_cache_store_stripped (const char *irx, entry_t * entry,
+                              char *stripped, int stripped_size);
+void irx_cache_collect ();
+void image_cache_key (entry_t * entry, int nb_entries, int compression,
+                      unsigned char key[SHA256_SIZE]);
+char *object_name (const char *dir, const unsigned char key[SHA256_SIZE],
+                   char **subdir);
+int image_cache_fetch (const char *image_name,
+                       const unsigned char key[SHA256_SIZE]);
+void image_cache_store (const char *image_name,
+                        const unsigned char key[SHA256_SIZE]);
+void store_entry (const char *name, const void *data, int size,
+                  const unsigned char *digest);
+int index_wanted (const char *image_name);
+void index_write (const char *image_name, entry_t * entry, int nb_entries,
+                  int compression);
+int index_read (const char *image_name, int fd, entry_t ** res_entries,
+                int *res_nb_entries, int *compression,
+                unsigned char **res_hashes);
 int digits_in_number (int num);
 char *basename (char *path);
 void verbose_set_length_of_size_column (int length);
 void verbose_set_length_of_name_column (int length);
 void verbose_display_header ();
 void verbose_dump_entry_info (entry_t * e);
+time_t build_time ();
+void time_to_tm (time_t * time, struct tm *m);
 int time_t_to_hexa (time_t * time);
+int parse_iopmod_section (const char *iopmodsec, int size,
+                          unsigned short *version, char *descr,
+                          int descr_size);
+int iopmod_section_index (const Elf32_Shdr * esh, int shnum,
+                          const char *strtab, int strtab_size);
+void cleanup_push (void (*fn) (void *), void *arg);
+void cleanup_pop (int run);
+void free_indirect (void *p);
+void warning (char *format, ...);
 void fatal (char *format, ...);
 void fatal_with_errno (char *format, ...);
 
@@ -31,6 +31,14 @@
 #define ELF_MAGIC "\177ELF"
 #define ELF_PT_LOAD 1
 
+#define ELF_SHT_SYMTAB  2       /* Symbol table */
+#define ELF_SHT_RELA    4       /* Relocation entries with addends */
+#define ELF_SHT_NOBITS  8       /* Program space with no data (bss) */
+#define ELF_SHT_REL     9       /* Relocation entries, no addends */
+#define ELF_SHT_IOPMOD  0x70000080      /* IRX module information */
+#define ELF_SHF_ALLOC   0x2     /* Occupies memory during execution */
+#define ELF_SHN_LORESERVE 0xff00        /* Start of reserved indices */
+
 // Check: should work on 64 bits architectures
 typedef unsigned char u8;
 typedef unsigned short Elf32_Half;
@@ -70,4 +78,26 @@ typedef struct {
   Elf32_Word sh_entsize;        /* Entry size if section holds table */
 } Elf32_Shdr;
 
+/* Program segment header.  */
+typedef struct {
+  Elf32_Word p_type;            /* Segment type */
+  Elf32_Off p_offset;           /* Segment file offset */
+  Elf32_Addr p_vaddr;           /* Segment virtual address */
+  Elf32_Addr p_paddr;           /* Segment physical address */
+  Elf32_Word p_filesz;          /* Segment size in file */
+  Elf32_Word p_memsz;           /* Segment size in memory */
+  Elf32_Word p_flags;           /* Segment flags */
+  Elf32_Word p_align;           /* Segment alignment */
+} Elf32_Phdr;
+
+/* Symbol table entry.  */
+typedef struct {
+  Elf32_Word st_name;           /* Symbol name (string tbl index) */
+  Elf32_Addr st_value;          /* Symbol value */
+  Elf32_Word st_size;           /* Symbol size */
+  unsigned char st_info;        /* Symbol type and binding */
+  unsigned char st_other;       /* Symbol visibility */
+  Elf32_Half st_shndx;          /* Section index */
+} Elf32_Sym;
+
 #endif
@@ -0,0 +1,273 @@
+/**
+ * ps2img - Create, inspect or extract Playstation 2 ROM image files
+ * Copyright (c) 2005 Damien Ciabrini (dciabrin), Olivier Parra (yo6)
+ *
+ *     ps2img is free software; you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as
+ *     published by the Free Software Foundation; either version 2 of
+ *     the License, or (at your option) any later version.
+ *
+ *     ps2img is distributed in the hope that it will be useful, but
+ *     WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public
+ *     License along with ps2img; if not, write to the Free Software
+ *     Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *     02111-1307 USA
+ *
+ * $Id$
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+
+#include "common.h"
+
+
+/*---------------------------------------------------------------------*/
+/*    EXTINFO records ...                                              */
+/*    -------------------------------------------------------------    */
+/*    The EXTINFO section holds, for each entry of the ROMDIR, a       */
+/*    list of records: an extinfo_t header followed by a payload of    */
+/*    `size' bytes. Each kind of record known by ps2img is described   */
+/*    once in the table below: its id, the flag telling whether an     */
+/*    entry has it, and where its payload lives in entry_t. The same   */
+/*    table is used to size, write and read the records, which are     */
+/*    written in its order.                                            */
+/*---------------------------------------------------------------------*/
+#define EXTINFO_WORD    0       // a 4 bytes field
+#define EXTINFO_VALUE   1       // a 2 bytes field, kept in the header
+#define EXTINFO_STRING  2       // a string field, padded to 4 bytes
+#define EXTINFO_ZERO    3       // 4 bytes of zeroes, no field
+
+typedef struct
+{
+  unsigned char id;
+  char flag;
+  char kind;
+  int field;
+  // for a string, where the entry points to it when it is decoded
+  int view;
+} extinfo_codec_t;
+
+static const extinfo_codec_t extinfo_codecs[] = {
+  {EXTINFO_ID_DATE, ENTRY_FLAG_DATE, EXTINFO_WORD,
+   offsetof( entry_t, date ), -1},
+  {EXTINFO_ID_VERSION, ENTRY_FLAG_VERSION, EXTINFO_VALUE,
+   offsetof( entry_t, version ), -1},
+  {EXTINFO_ID_DESCR, ENTRY_FLAG_DESCR, EXTINFO_STRING,
+   offsetof( entry_t, descr ), offsetof( entry_t, descr_view )},
+  {EXTINFO_ID_NULL, ENTRY_FLAG_NULL, EXTINFO_ZERO, 0, -1},
+};
+
+#define NB_EXTINFO_CODECS \
+  ( sizeof( extinfo_codecs ) / sizeof( extinfo_codecs[0] ) )
+
+// the codec of each id, NULL if unknown
+static const extinfo_codec_t *const extinfo_codec_of_id[256] = {
+  [EXTINFO_ID_DATE] = &extinfo_codecs[0],
+  [EXTINFO_ID_VERSION] = &extinfo_codecs[1],
+  [EXTINFO_ID_DESCR] = &extinfo_codecs[2],
+  [EXTINFO_ID_NULL] = &extinfo_codecs[3],
+};
+
+
+/*---------------------------------------------------------------------*/
+/*    Layouts ...                                                      */
+/*    -------------------------------------------------------------    */
+/*    The records of an entry only depend on its flags. For each set   */
+/*    of flags, the layout lists its records in order, with their      */
+/*    headers as written, and the size of the records without the      */
+/*    payload of their string. It is computed from the table once, so  */
+/*    that sizing and writing the records of an entry never walks the  */
+/*    codecs it does not have. ps2img is built without optimizations,  */
+/*    so the loops over records keep their cursors in registers, and   */
+/*    string_length is forcibly inlined.                               */
+/*---------------------------------------------------------------------*/
+#define NB_EXTINFO_LAYOUTS 16   // all the sets of ENTRY_FLAG_* flags
+
+typedef struct
+{
+  // the size of a string is only known when it is written
+  extinfo_t header;
+  int kind;
+  int field;
+} extinfo_record_t;
+
+typedef struct
+{
+  int nb_records;
+  extinfo_record_t record[NB_EXTINFO_CODECS];
+  int fixed_size;
+  // offset of the string field in entry_t, or -1
+  int string_field;
+} extinfo_layout_t;
+
+static extinfo_layout_t extinfo_layouts[NB_EXTINFO_LAYOUTS];
+
+static void __attribute__ ( ( constructor ) ) extinfo_init_layouts( void )
+{
+  const extinfo_codec_t *c;
+  extinfo_layout_t *l;
+  extinfo_record_t *r;
+  int flags;
+
+  for ( flags = 0; flags < NB_EXTINFO_LAYOUTS; flags++ ) {
+    l = &extinfo_layouts[flags];
+    l->string_field = -1;
+    for ( c = extinfo_codecs; c < extinfo_codecs + NB_EXTINFO_CODECS; c++ ) {
+      if ( !( flags & c->flag ) )
+        continue;
+      r = &l->record[l->nb_records++];
+      r->header.id = c->id;
+      r->kind = c->kind;
+      r->field = c->field;
+      if ( c->kind == EXTINFO_STRING )
+        l->string_field = c->field;
+      else if ( c->kind != EXTINFO_VALUE )
+        r->header.size = 4;
+      l->fixed_size += sizeof( extinfo_t ) + r->header.size;
+    }
+  }
+}
+
+#define EXTINFO_LAYOUT( entry ) \
+  ( &extinfo_layouts[( entry )->flags & ( NB_EXTINFO_LAYOUTS - 1 )] )
+
+// length of a string field once written, as the size of a record is a byte
+static inline __attribute__ ( ( always_inline ) )
+int string_length( const char *field )
+{
+  int len = strlen( field );
+  return len < EXTINFO_DESCR_MAX ? len : EXTINFO_DESCR_MAX - 1;
+}
+
+
+/*---------------------------------------------------------------------*/
+/*    extinfo_size                                                     */
+/*    -------------------------------------------------------------    */
+/*    Compute the size the records of this entry take in the EXTINFO   */
+/*    section. The records of an entry read from an image are kept     */
+/*    as they are.                                                     */
+/*---------------------------------------------------------------------*/
+int extinfo_size( entry_t * entry )
+{
+  register const extinfo_layout_t *l;
+
+  if ( entry->raw_extinfo )
+    return entry->raw_extinfo_size;
+  l = EXTINFO_LAYOUT( entry );
+  if ( l->string_field == -1 )
+    return l->fixed_size;
+  return l->fixed_size +
+    PAD4( string_length( ( char * ) entry + l->string_field ) + 1 );
+}
+
+
+/*---------------------------------------------------------------------*/
+/*    extinfo_encode                                                   */
+/*    -------------------------------------------------------------    */
+/*    Write the records of this entry at out, which must hold          */
+/*    extinfo_size( entry ) bytes. Return the number of bytes written. */
+/*---------------------------------------------------------------------*/
+int extinfo_encode( entry_t * entry, char *out )
+{
+  const extinfo_layout_t *l;
+  register const extinfo_record_t *r, *end;
+  register extinfo_t *inf;
+  register char *p = out, *field;
+  int len;
+
+  if ( entry->raw_extinfo ) {
+    memcpy( out, entry->raw_extinfo, entry->raw_extinfo_size );
+    return entry->raw_extinfo_size;
+  }
+  l = EXTINFO_LAYOUT( entry );
+  for ( r = l->record, end = r + l->nb_records; r < end; r++ ) {
+    inf = ( extinfo_t * ) p;
+    *inf = r->header;
+    p += sizeof( extinfo_t );
+    field = ( char * ) entry + r->field;
+    switch ( r->kind ) {
+    case EXTINFO_WORD:
+      *( unsigned * ) p = *( unsigned * ) field;
+      p += 4;
+      break;
+    case EXTINFO_VALUE:
+      inf->value = *( unsigned short * ) field;
+      break;
+    case EXTINFO_STRING:
+      len = string_length( field );
+      inf->size = PAD4( len + 1 );
+      // the padding lies in the last word of the payload
+      *( unsigned * ) ( p + ( len & ~0x3 ) ) = 0;
+      memcpy( p, field, len );
+      p += inf->size;
+      break;
+    case EXTINFO_ZERO:
+      *( unsigned * ) p = 0;
+      p += 4;
+      break;
+    }
+  }
+  return p - out;
+}
+
+
+/*---------------------------------------------------------------------*/
+/*    extinfo_decode                                                   */
+/*    -------------------------------------------------------------    */
+/*    Fill an entry from its size bytes of records. Records ps2img     */
+/*    does not know are skipped, but the entry keeps a view on all     */
+/*    its records, so that they are written back unchanged. Strings    */
+/*    are not copied: the entry points to them in the records, which   */
+/*    must outlive it. Return 0 if the records are malformed.          */
+/*---------------------------------------------------------------------*/
+int extinfo_decode( entry_t * entry, char *extinfo, int size )
+{
+  register const extinfo_codec_t *c;
+  register extinfo_t *inf;
+  register char *p = extinfo, *end = extinfo + size, *data, *field;
+
+  entry->flags = 0;
+  entry->descr_view = NULL;
+  entry->raw_extinfo = extinfo;
+  entry->raw_extinfo_size = size;
+  while ( p < end ) {
+    inf = ( extinfo_t * ) p;
+    data = p + sizeof( extinfo_t );
+    if ( end - p < sizeof( extinfo_t ) || end - data < inf->size )
+      return 0;
+    p = data + inf->size;
+    if ( ( c = extinfo_codec_of_id[inf->id] ) == NULL )
+      continue;
+
+    field = ( char * ) entry + c->field;
+    switch ( c->kind ) {
+    case EXTINFO_WORD:
+      if ( inf->size < 4 )
+        return 0;
+      *( unsigned * ) field = *( unsigned * ) data;
+      break;
+    case EXTINFO_VALUE:
+      *( unsigned short * ) field = inf->value;
+      break;
+    case EXTINFO_STRING:
+      if ( memchr( data, '\0', inf->size ) )
+        *( const char ** ) ( ( char * ) entry + c->view ) = data;
+      else {
+        // not terminated in its record: a record holds at most 255
+        // bytes, the field is bigger
+        memcpy( field, data, inf->size );
+        field[inf->size] = '\0';
+      }
+      break;
+    }
+    entry->flags |= c->flag;
+  }
+  return 1;
+}
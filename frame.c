@@ -0,0 +1,102 @@
+/**
+ * ps2img - Create, inspect or extract Playstation 2 ROM image files
+ * Copyright (c) 2005 Damien Ciabrini (dciabrin), Olivier Parra (yo6)
+ *
+ *     ps2img is free software; you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as
+ *     published by the Free Software Foundation; either version 2 of
+ *     the License, or (at your option) any later version.
+ *
+ *     ps2img is distributed in the hope that it will be useful, but
+ *     WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public
+ *     License along with ps2img; if not, write to the Free Software
+ *     Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *     02111-1307 USA
+ *
+ * $Id$
+ */
+
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include "serve.h"
+
+
+static int write_all( int fd, const void *data, int size )
+{
+  const char *p = data;
+  while ( size > 0 ) {
+    ssize_t n = write( fd, p, size );
+    if ( n == -1 && errno == EINTR )
+      continue;
+    if ( n <= 0 )
+      return 0;
+    p += n;
+    size -= n;
+  }
+  return 1;
+}
+
+static int read_all( int fd, void *data, int size )
+{
+  char *p = data;
+  while ( size > 0 ) {
+    ssize_t n = read( fd, p, size );
+    if ( n == -1 && errno == EINTR )
+      continue;
+    if ( n <= 0 )
+      return 0;
+    p += n;
+    size -= n;
+  }
+  return 1;
+}
+
+
+/*---------------------------------------------------------------------*/
+/*    frame_write ...                                                  */
+/*    -------------------------------------------------------------    */
+/*    Send a frame. Returns 0 if the peer went away.                   */
+/*---------------------------------------------------------------------*/
+int frame_write( int fd, int type, const void *data, int size )
+{
+  unsigned char hdr[5];
+  hdr[0] = type;
+  hdr[1] = size >> 24;
+  hdr[2] = size >> 16;
+  hdr[3] = size >> 8;
+  hdr[4] = size;
+  return write_all( fd, hdr, sizeof( hdr ) ) && write_all( fd, data, size );
+}
+
+
+/*---------------------------------------------------------------------*/
+/*    frame_read ...                                                   */
+/*    -------------------------------------------------------------    */
+/*    Receive a frame. The payload is allocated with an extra NUL      */
+/*    byte at its end. Returns 0 on end of stream or invalid frame.    */
+/*---------------------------------------------------------------------*/
+int frame_read( int fd, int *type, char **data, int *size )
+{
+  unsigned char hdr[5];
+
+  if ( !read_all( fd, hdr, sizeof( hdr ) ) )
+    return 0;
+  *type = hdr[0];
+  *size = ( hdr[1] << 24 ) | ( hdr[2] << 16 ) | ( hdr[3] << 8 ) | hdr[4];
+  if ( *size < 0 || *size > FRAME_MAX_SIZE )
+    return 0;
+
+  if ( ( *data = malloc( *size + 1 ) ) == NULL )
+    return 0;
+  if ( !read_all( fd, *data, *size ) ) {
+    free( *data );
+    return 0;
+  }
+  ( *data )[*size] = '\0';
+  return 1;
+}
@@ -0,0 +1,247 @@
+/**
+ * ps2img - Create, inspect or extract Playstation 2 ROM image files
+ * Copyright (c) 2005 Damien Ciabrini (dciabrin), Olivier Parra (yo6)
+ *
+ *     ps2img is free software; you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as
+ *     published by the Free Software Foundation; either version 2 of
+ *     the License, or (at your option) any later version.
+ *
+ *     ps2img is distributed in the hope that it will be useful, but
+ *     WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public
+ *     License along with ps2img; if not, write to the Free Software
+ *     Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *     02111-1307 USA
+ *
+ * $Id$
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "common.h"
+#include "sha256.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+/*---------------------------------------------------------------------*/
+/*    Index sidecar layout:                                            */
+/*    -------------------------------------------------------------    */
+/*    An image IMG may come with an index file IMG.idx, holding the    */
+/*    parsed ROMDIR and EXTINFO sections of the image, so that they    */
+/*    don't have to be parsed again for each query. The index is       */
+/*    only trusted when the size, modification time and inode of the   */
+/*    image match the ones it was built for.                           */
+/*    The index is made of a header followed by one record per         */
+/*    ROMDIR entry. It is stored in the host byte order.               */
+/*---------------------------------------------------------------------*/
+#define INDEX_MAGIC   "PS2IDX01"
+#define INDEX_SUFFIX  ".idx"
+
+typedef struct
+{
+  char magic[8];
+  long long image_size;
+  long long image_mtime_sec;
+  long long image_mtime_nsec;
+  long long image_ino;
+  int compression;
+  int nb_entries;
+} index_header_t;
+
+typedef struct
+{
+  char name[10];
+  char flags;
+  char pad;
+  unsigned date;
+  unsigned short version;
+  unsigned short pad2;
+  int irx_size;
+  int irx_offset;
+  char descr[256];
+  unsigned char hash[SHA256_SIZE];
+} index_record_t;
+
+
+static char *index_name( const char *image_name )
+{
+  char *name = malloc( strlen( image_name ) + sizeof( INDEX_SUFFIX ) );
+  if ( name == NULL )
+    fatal_with_errno( "Cannot allocate memory" );
+  sprintf( name, "%s%s", image_name, INDEX_SUFFIX );
+  return name;
+}
+
+
+/*---------------------------------------------------------------------*/
+/*    index_wanted ...                                                 */
+/*    -------------------------------------------------------------    */
+/*    An index is maintained when asked to, or when one already        */
+/*    exists next to the image.                                        */
+/*---------------------------------------------------------------------*/
+int index_wanted( const char *image_name )
+{
+  char *name;
+  int exists;
+
+  if ( build_index )
+    return 1;
+  name = index_name( image_name );
+  exists = access( name, F_OK ) == 0;
+  free( name );
+  return exists;
+}
+
+
+/*---------------------------------------------------------------------*/
+/*    index_write ...                                                  */
+/*    -------------------------------------------------------------    */
+/*    Save the index of an image that has just been written to disk.   */
+/*    The entries must hold their payload and its offset.              */
+/*---------------------------------------------------------------------*/
+void index_write( const char *image_name, entry_t * entry, int nb_entries,
+                  int compression )
+{
+  index_header_t *hdr;
+  index_record_t *rec;
+  struct stat st;
+  int size, i;
+  char *name;
+
+  if ( stat( image_name, &st ) == -1 )
+    fatal_with_errno( "Cannot stat file %s", image_name );
+
+  size = sizeof( index_header_t ) + nb_entries * sizeof( index_record_t );
+  if ( ( hdr = malloc( size ) ) == NULL )
+    fatal_with_errno( "Cannot allocate %d bytes of memory", size );
+  memset( hdr, 0, size );
+
+  memcpy( hdr->magic, INDEX_MAGIC, sizeof( hdr->magic ) );
+  hdr->image_size = st.st_size;
+  hdr->image_mtime_sec = st.st_mtim.tv_sec;
+  hdr->image_mtime_nsec = st.st_mtim.tv_nsec;
+  hdr->image_ino = st.st_ino;
+  hdr->compression = compression;
+  hdr->nb_entries = nb_entries;
+
+  rec = ( index_record_t * ) ( hdr + 1 );
+  for ( i = 0; i < nb_entries; i++ ) {
+    memcpy( rec[i].name, entry[i].name, sizeof( rec[i].name ) );
+    rec[i].flags = entry[i].flags;
+    rec[i].date = entry[i].date;
+    rec[i].version = entry[i].version;
+    rec[i].irx_size = entry[i].irx_size;
+    rec[i].irx_offset = entry[i].irx_offset;
+    if ( entry[i].flags & ENTRY_FLAG_DESCR )
+      strncpy( rec[i].descr, entry_descr( &entry[i] ),
+               sizeof( rec[i].descr ) - 1 );
+    // the first three entries are the image's own meta-data
+    if ( i > 2 )
+      sha256_digest( entry[i].irx_binary, entry[i].irx_size, rec[i].hash );
+  }
+
+  name = index_name( image_name );
+  write_file( name, ( unsigned char * ) hdr, size );
+  free( name );
+  free( hdr );
+}
+
+
+/*---------------------------------------------------------------------*/
+/*    index_read ...                                                   */
+/*    -------------------------------------------------------------    */
+/*    Load the entry descriptors of an image from its index, if it     */
+/*    is up to date. Payloads are not loaded: only their offset in     */
+/*    the uncompressed image is known. Returns 0 when there is no      */
+/*    usable index.                                                    */
+/*    When the image is already opened as fd, the index is checked    */
+/*    against that very file, and not against whatever image_name     */
+/*    designates now. When res_hashes is not NULL, it receives the     */
+/*    SHA-256 digests of the payloads, SHA256_SIZE bytes per entry.    */
+/*---------------------------------------------------------------------*/
+int index_read( const char *image_name, int fd, entry_t ** res_entries,
+                int *res_nb_entries, int *compression,
+                unsigned char **res_hashes )
+{
+  index_header_t hdr;
+  index_record_t rec;
+  struct stat st;
+  entry_t *entries;
+  unsigned char *hashes = NULL;
+  int max_size = 0;
+  int max_name = 0;
+  int i, ok = 0;
+  char *name;
+  FILE *f;
+
+  if ( ( fd == -1 ? stat( image_name, &st ) : fstat( fd, &st ) ) == -1 )
+    return 0;
+
+  name = index_name( image_name );
+  f = fopen( name, "r" );
+  free( name );
+  if ( f == NULL )
+    return 0;
+
+  if ( fread( &hdr, sizeof( hdr ), 1, f ) != 1 ||
+       memcmp( hdr.magic, INDEX_MAGIC, sizeof( hdr.magic ) ) != 0 ||
+       hdr.image_size != st.st_size ||
+       hdr.image_mtime_sec != st.st_mtim.tv_sec ||
+       hdr.image_mtime_nsec != st.st_mtim.tv_nsec ||
+       hdr.image_ino != st.st_ino || hdr.nb_entries < 3 )
+    goto out;
+
+  if ( ( entries = malloc( hdr.nb_entries * sizeof( entry_t ) ) ) == NULL )
+    fatal_with_errno( "Cannot allocate memory" );
+  if ( res_hashes &&
+       ( hashes = malloc( hdr.nb_entries * SHA256_SIZE ) ) == NULL )
+    fatal_with_errno( "Cannot allocate memory" );
+
+  for ( i = 0; i < hdr.nb_entries; i++ ) {
+    if ( fread( &rec, sizeof( rec ), 1, f ) != 1 ) {
+      free( entries );
+      free( hashes );
+      goto out;
+    }
+    memcpy( entries[i].name, rec.name, sizeof( rec.name ) );
+    entries[i].name[sizeof( entries[i].name ) - 1] = '\0';
+    entries[i].flags = rec.flags;
+    entries[i].date = rec.date;
+    entries[i].version = rec.version;
+    rec.descr[sizeof( rec.descr ) - 1] = '\0';
+    strcpy( entries[i].descr, rec.descr );
+    entries[i].irx_size = rec.irx_size;
+    entries[i].irx_offset = rec.irx_offset;
+    entries[i].irx_binary = NULL;
+    entries[i].descr_view = NULL;
+    entries[i].raw_extinfo = NULL;
+    if ( hashes )
+      memcpy( hashes + i * SHA256_SIZE, rec.hash, SHA256_SIZE );
+    if ( max_name < strlen( entries[i].name ) )
+      max_name = strlen( entries[i].name );
+    if ( i > 2 && max_size < rec.irx_size )
+      max_size = rec.irx_size;
+  }
+
+  verbose_set_length_of_size_column( digits_in_number( max_size ) );
+  verbose_set_length_of_name_column( max_name );
+  *res_entries = entries;
+  *res_nb_entries = hdr.nb_entries;
+  *compression = hdr.compression;
+  if ( res_hashes )
+    *res_hashes = hashes;
+  ok = 1;
+
+out:
+  fclose( f );
+  return ok;
+}
@@ -0,0 +1,354 @@
+/**
+ * ps2img - Create, inspect or extract Playstation 2 ROM image files
+ * Copyright (c) 2005 Damien Ciabrini (dciabrin), Olivier Parra (yo6)
+ *
+ *     ps2img is free software; you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as
+ *     published by the Free Software Foundation; either version 2 of
+ *     the License, or (at your option) any later version.
+ *
+ *     ps2img is distributed in the hope that it will be useful, but
+ *     WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public
+ *     License along with ps2img; if not, write to the Free Software
+ *     Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *     02111-1307 USA
+ *
+ * $Id$
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "common.h"
+#include "elf.h"
+#include "sha256.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+
+// Upper bounds of what we accept to read from the headers of an IRX
+#define MAX_SHSTRTAB_SIZE 0x10000
+#define MAX_IOPMOD_SIZE   0x1000
+
+
+/*---------------------------------------------------------------------*/
+/*    The catalog entry structure ...                                  */
+/*---------------------------------------------------------------------*/
+typedef struct
+{
+  char *path;
+  int explicit;
+  int valid;
+  unsigned short version;
+  char descr[256];
+  long size;
+  time_t mtime;
+  char fingerprint[SHA256_HEX_SIZE];
+} catalog_entry_t;
+
+typedef struct
+{
+  dev_t dev;
+  ino_t ino;
+} catalog_dir_t;
+
+typedef struct
+{
+  catalog_entry_t *entry;
+  int nb_entries;
+  int next;
+  pthread_mutex_t lock;
+  // directories already walked, so that symlink loops end
+  catalog_dir_t *dir;
+  int nb_dirs;
+  int allocated_dirs;
+} catalog_t;
+
+
+/*---------------------------------------------------------------------*/
+/*    pread_all ...                                                    */
+/*    -------------------------------------------------------------    */
+/*    Read exactly size bytes at a given offset. Returns 0 on          */
+/*    failure or short read.                                           */
+/*---------------------------------------------------------------------*/
+static int pread_all( int fd, void *buf, int size, off_t offset )
+{
+  char *p = buf;
+  while ( size > 0 ) {
+    ssize_t n = pread( fd, p, size, offset );
+    if ( n <= 0 )
+      return 0;
+    p += n;
+    offset += n;
+    size -= n;
+  }
+  return 1;
+}
+
+
+/*---------------------------------------------------------------------*/
+/*    inspect_irx_headers ...                                          */
+/*    -------------------------------------------------------------    */
+/*    Fill a catalog entry by reading only the ELF header, the         */
+/*    section header table, the section names and the .iopmod          */
+/*    section of an IRX. The fingerprint is a hash of those bytes      */
+/*    only, so that the code of the IRX never has to be read: two      */
+/*    IRXs that differ only in their code have the same fingerprint.   */
+/*---------------------------------------------------------------------*/
+static void inspect_irx_headers( catalog_entry_t * c )
+{
+  Elf32_Ehdr eh;
+  Elf32_Shdr *esh = NULL;
+  char *sh_str_table = NULL;
+  char *iopmodsec = NULL;
+  struct stat st;
+  sha256_t ctx;
+  unsigned char digest[SHA256_SIZE];
+  int fd, i, size, strtab_size;
+
+  c->valid = 0;
+  if ( ( fd = open( c->path, O_RDONLY ) ) == -1 )
+    return;
+  if ( fstat( fd, &st ) == -1 )
+    goto out;
+  c->size = st.st_size;
+  c->mtime = st.st_mtime;
+
+  // the same checks as find_iopmod_section, so that --plan accepts
+  // the IRXs -c accepts
+  if ( !pread_all( fd, &eh, sizeof( eh ), 0 ) ||
+       memcmp( eh.e_ident, ELF_MAGIC, 4 ) != 0 ||
+       eh.e_shentsize != sizeof( Elf32_Shdr ) ||
+       eh.e_shstrndx >= eh.e_shnum ||
+       eh.e_shoff > st.st_size ||
+       eh.e_shnum * sizeof( Elf32_Shdr ) > st.st_size - eh.e_shoff )
+    goto out;
+
+  if ( ( esh = malloc( eh.e_shnum * sizeof( Elf32_Shdr ) ) ) == NULL ||
+       !pread_all( fd, esh, eh.e_shnum * sizeof( Elf32_Shdr ), eh.e_shoff ) )
+    goto out;
+
+  strtab_size = esh[eh.e_shstrndx].sh_size;
+  if ( esh[eh.e_shstrndx].sh_offset > st.st_size ||
+       strtab_size > st.st_size - esh[eh.e_shstrndx].sh_offset ||
+       strtab_size > MAX_SHSTRTAB_SIZE ||
+       ( sh_str_table = malloc( strtab_size + 1 ) ) == NULL ||
+       !pread_all( fd, sh_str_table, strtab_size,
+                   esh[eh.e_shstrndx].sh_offset ) )
+    goto out;
+  sh_str_table[strtab_size] = '\0';
+
+  sha256_init( &ctx );
+  sha256_update( &ctx, &eh, sizeof( eh ) );
+  sha256_update( &ctx, esh, eh.e_shnum * sizeof( Elf32_Shdr ) );
+
+  i = iopmod_section_index( esh, eh.e_shnum, sh_str_table, strtab_size );
+  if ( i == -1 || esh[i].sh_offset > st.st_size ||
+       esh[i].sh_size > st.st_size - esh[i].sh_offset )
+    goto out;
+  size = esh[i].sh_size;
+  if ( size > MAX_IOPMOD_SIZE )
+    size = MAX_IOPMOD_SIZE;
+  if ( ( iopmodsec = malloc( size ) ) == NULL ||
+       !pread_all( fd, iopmodsec, size, esh[i].sh_offset ) )
+    goto out;
+  if ( !parse_iopmod_section( iopmodsec, size, &c->version, c->descr,
+                              sizeof( c->descr ) ) )
+    goto out;
+  sha256_update( &ctx, iopmodsec, size );
+  sha256_final( &ctx, digest );
+  sha256_to_hex( digest, c->fingerprint );
+  c->valid = 1;
+
+out:
+  free( iopmodsec );
+  free( sh_str_table );
+  free( esh );
+  close( fd );
+}
+
+
+/*---------------------------------------------------------------------*/
+/*    init_entry_from_irx_headers ...                                  */
+/*    -------------------------------------------------------------    */
+/*    Same as init_entry_from_irx, but only the headers of the IRX     */
+/*    are read: the entry gets no binary.                              */
+/*---------------------------------------------------------------------*/
+void init_entry_from_irx_headers( entry_t * entry, char *irx )
+{
+  catalog_entry_t c;
+  char *name = basename( irx );
+
+  memset( &c, 0, sizeof( c ) );
+  c.path = irx;
+  inspect_irx_headers( &c );
+  if ( !c.valid )
+    fatal( "Invalid IRX %s: cannot read its .iopmod section.", irx );
+
+  if ( strlen( name ) > 9 )
+    fatal( "invalid ROM file entry %s: name too long", name );
+  strcpy( entry->name, name );
+  entry->flags = ENTRY_FLAG_DATE | ENTRY_FLAG_VERSION | ENTRY_FLAG_DESCR;
+  entry->date = time_t_to_hexa( &c.mtime );
+  entry->version = c.version;
+  strcpy( entry->descr, c.descr );
+  entry->irx_size = c.size;
+  entry->irx_binary = NULL;
+  entry->descr_view = NULL;
+  entry->raw_extinfo = NULL;
+}
+
+
+/*---------------------------------------------------------------------*/
+/*    inspect_worker ...                                               */
+/*    -------------------------------------------------------------    */
+/*    Thread body: inspect catalog entries until none is left.         */
+/*---------------------------------------------------------------------*/
+static void *inspect_worker( void *arg )
+{
+  catalog_t *cat = arg;
+  for ( ;; ) {
+    pthread_mutex_lock( &cat->lock );
+    int i = cat->next++;
+    pthread_mutex_unlock( &cat->lock );
+    if ( i >= cat->nb_entries )
+      return NULL;
+    inspect_irx_headers( &cat->entry[i] );
+  }
+}
+
+
+/*---------------------------------------------------------------------*/
+/*    catalog_add_path ...                                             */
+/*    -------------------------------------------------------------    */
+/*    Register a file in the catalog, or all files below a directory.  */
+/*    Symbolic links are followed, but a directory is walked once.     */
+/*---------------------------------------------------------------------*/
+static void catalog_add_path( catalog_t * cat, int *allocated, char *path,
+                              int explicit )
+{
+  struct stat st;
+  if ( stat( path, &st ) == -1 ) {
+    if ( explicit )
+      fatal_with_errno( "Cannot stat file %s", path );
+    return;
+  }
+
+  if ( S_ISDIR( st.st_mode ) ) {
+    DIR *dir;
+    struct dirent *de;
+    int i;
+    for ( i = 0; i < cat->nb_dirs; i++ )
+      if ( cat->dir[i].dev == st.st_dev && cat->dir[i].ino == st.st_ino )
+        return;
+    if ( cat->nb_dirs == cat->allocated_dirs ) {
+      cat->allocated_dirs = cat->allocated_dirs ? cat->allocated_dirs * 2 : 16;
+      cat->dir = realloc( cat->dir,
+                          cat->allocated_dirs * sizeof( catalog_dir_t ) );
+      if ( cat->dir == NULL )
+        fatal_with_errno( "Cannot allocate memory" );
+    }
+    cat->dir[cat->nb_dirs].dev = st.st_dev;
+    cat->dir[cat->nb_dirs].ino = st.st_ino;
+    cat->nb_dirs++;
+    if ( ( dir = opendir( path ) ) == NULL )
+      fatal_with_errno( "Cannot open directory %s", path );
+    while ( ( de = readdir( dir ) ) != NULL ) {
+      if ( strcmp( de->d_name, "." ) == 0 || strcmp( de->d_name, ".." ) == 0 )
+        continue;
+      char *sub = malloc( strlen( path ) + strlen( de->d_name ) + 2 );
+      if ( sub == NULL )
+        fatal_with_errno( "Cannot allocate memory" );
+      sprintf( sub, "%s/%s", path, de->d_name );
+      catalog_add_path( cat, allocated, sub, 0 );
+    }
+    closedir( dir );
+    return;
+  }
+
+  if ( !S_ISREG( st.st_mode ) )
+    return;
+
+  if ( cat->nb_entries == *allocated ) {
+    *allocated = *allocated ? *allocated * 2 : 256;
+    cat->entry = realloc( cat->entry, *allocated * sizeof( catalog_entry_t ) );
+    if ( cat->entry == NULL )
+      fatal_with_errno( "Cannot allocate %d catalog entries", *allocated );
+  }
+  memset( &cat->entry[cat->nb_entries], 0, sizeof( catalog_entry_t ) );
+  cat->entry[cat->nb_entries].path = path;
+  cat->entry[cat->nb_entries].explicit = explicit;
+  cat->nb_entries++;
+}
+
+
+static int compare_catalog_entries( const void *a, const void *b )
+{
+  const catalog_entry_t *x = a, *y = b;
+  int r = strcmp( basename( x->path ), basename( y->path ) );
+  if ( r == 0 )
+    r = ( int ) x->version - ( int ) y->version;
+  if ( r == 0 )
+    r = strcmp( x->path, y->path );
+  return r;
+}
+
+
+/*---------------------------------------------------------------------*/
+/*    inspect_irx_files ...                                            */
+/*    -------------------------------------------------------------    */
+/*    Print a catalog of the IRXs found in files and directories,      */
+/*    one line per IRX sorted by name and version:                     */
+/*      NAME  VERSION  SIZE  FINGERPRINT  DESCRIPTION  PATH            */
+/*    Fields are separated by tabs so that the output can be fed to    */
+/*    sort(1) or cut(1).                                               */
+/*---------------------------------------------------------------------*/
+void inspect_irx_files( char *args[], int num_args )
+{
+  catalog_t cat;
+  int allocated = 0;
+  int i, nb_threads;
+
+  memset( &cat, 0, sizeof( cat ) );
+  pthread_mutex_init( &cat.lock, NULL );
+  for ( i = 0; i < num_args; i++ )
+    catalog_add_path( &cat, &allocated, args[i], 1 );
+
+  nb_threads = sysconf( _SC_NPROCESSORS_ONLN );
+  if ( nb_threads < 1 )
+    nb_threads = 1;
+  if ( nb_threads > cat.nb_entries )
+    nb_threads = cat.nb_entries;
+
+  pthread_t threads[nb_threads > 0 ? nb_threads : 1];
+  for ( i = 0; i < nb_threads; i++ )
+    if ( pthread_create( &threads[i], NULL, inspect_worker, &cat ) != 0 )
+      fatal( "Cannot create inspection thread" );
+  for ( i = 0; i < nb_threads; i++ )
+    pthread_join( threads[i], NULL );
+
+  for ( i = 0; i < cat.nb_entries; i++ )
+    // explicitly named files are reported when they are not IRXs
+    if ( !cat.entry[i].valid && ( cat.entry[i].explicit || verbose ) )
+      warning( "%s is not a valid IRX", cat.entry[i].path );
+
+  qsort( cat.entry, cat.nb_entries, sizeof( catalog_entry_t ),
+         compare_catalog_entries );
+
+  for ( i = 0; i < cat.nb_entries; i++ ) {
+    catalog_entry_t *c = &cat.entry[i];
+    if ( !c->valid )
+      continue;
+    printf( "%s\t%04X\t%ld\t%s\t%s\t%s\n", basename( c->path ), c->version,
+            c->size, c->fingerprint, c->descr, c->path );
+  }
+}
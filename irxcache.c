@@ -0,0 +1,397 @@
+/**
+ * ps2img - Create, inspect or extract Playstation 2 ROM image files
+ * Copyright (c) 2005 Damien Ciabrini (dciabrin), Olivier Parra (yo6)
+ *
+ *     ps2img is free software; you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as
+ *     published by the Free Software Foundation; either version 2 of
+ *     the License, or (at your option) any later version.
+ *
+ *     ps2img is distributed in the hope that it will be useful, but
+ *     WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public
+ *     License along with ps2img; if not, write to the Free Software
+ *     Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *     02111-1307 USA
+ *
+ * $Id$
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "common.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+/*---------------------------------------------------------------------*/
+/*    IRX cache ...                                                    */
+/*    -------------------------------------------------------------    */
+/*    Processes that stay resident keep the IRXs they loaded, along    */
+/*    with their parsed .iopmod meta-data, in a hash table indexed     */
+/*    by absolute path. A cached IRX is reused as long as the size,    */
+/*    modification time and inode of its file are unchanged.          */
+/*    The cache is disabled unless irx_cache_enable is called, and     */
+/*    may then be shared by several threads.                           */
+/*    The binaries it holds are limited to IRX_CACHE_MAX_SIZE bytes:   */
+/*    beyond that, the least recently used IRXs are evicted.           */
+/*---------------------------------------------------------------------*/
+#define IRX_CACHE_BUCKETS 1024
+#define IRX_CACHE_MAX_SIZE ( 64 << 20 )
+
+typedef struct irx_cache_entry
+{
+  char *path;
+  off_t size;
+  struct timespec mtime;
+  ino_t ino;
+  entry_t entry;
+  // the IRX without the sections the IOP does not need, once stripped
+  char *stripped;
+  int stripped_size;
+  unsigned bucket;
+  struct irx_cache_entry *next;
+  // the recency list, from the least recently used IRX
+  struct irx_cache_entry *older;
+  struct irx_cache_entry *newer;
+} irx_cache_entry_t;
+
+static irx_cache_entry_t **irx_cache;
+static irx_cache_entry_t *irx_cache_oldest;
+static irx_cache_entry_t *irx_cache_newest;
+static long irx_cache_size;
+static pthread_mutex_t irx_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Replaced binaries, until no image being built can use them anymore
+typedef struct irx_cache_retired
+{
+  char *binary;
+  struct irx_cache_retired *next;
+} irx_cache_retired_t;
+
+static irx_cache_retired_t *irx_cache_retired;
+
+// To be called with the lock held
+static void irx_cache_retire( char *binary )
+{
+  irx_cache_retired_t *r;
+  if ( ( r = malloc( sizeof( irx_cache_retired_t ) ) ) == NULL ) {
+    pthread_mutex_unlock( &irx_cache_lock );
+    fatal_with_errno( "Cannot allocate memory" );
+  }
+  r->binary = binary;
+  r->next = irx_cache_retired;
+  irx_cache_retired = r;
+}
+
+
+/*---------------------------------------------------------------------*/
+/*    Recency list ...                                                 */
+/*    -------------------------------------------------------------    */
+/*    To be called with the lock held.                                 */
+/*---------------------------------------------------------------------*/
+static long irx_cache_entry_size( irx_cache_entry_t * c )
+{
+  if ( c->stripped && c->stripped != c->entry.irx_binary )
+    return c->entry.irx_size + c->stripped_size;
+  return c->entry.irx_size;
+}
+
+static void irx_cache_unlink( irx_cache_entry_t * c )
+{
+  if ( c->older )
+    c->older->newer = c->newer;
+  else
+    irx_cache_oldest = c->newer;
+  if ( c->newer )
+    c->newer->older = c->older;
+  else
+    irx_cache_newest = c->older;
+}
+
+static void irx_cache_touch( irx_cache_entry_t * c )
+{
+  if ( c == irx_cache_newest )
+    return;
+  if ( c->older || c->newer || c == irx_cache_oldest )
+    irx_cache_unlink( c );
+  c->older = irx_cache_newest;
+  c->newer = NULL;
+  if ( irx_cache_newest )
+    irx_cache_newest->newer = c;
+  else
+    irx_cache_oldest = c;
+  irx_cache_newest = c;
+}
+
+// Evict the least recently used IRXs, but the one just cached, until
+// the cache fits in its limit
+static void irx_cache_evict( irx_cache_entry_t * keep )
+{
+  irx_cache_entry_t *c, **p;
+
+  while ( irx_cache_size > IRX_CACHE_MAX_SIZE &&
+          ( c = irx_cache_oldest ) != NULL && c != keep ) {
+    irx_cache_unlink( c );
+    for ( p = &irx_cache[c->bucket]; *p != c; p = &( *p )->next );
+    *p = c->next;
+    irx_cache_size -= irx_cache_entry_size( c );
+    if ( c->stripped && c->stripped != c->entry.irx_binary )
+      irx_cache_retire( c->stripped );
+    irx_cache_retire( c->entry.irx_binary );
+    free( c->path );
+    free( c );
+  }
+}
+
+
+void irx_cache_enable(  )
+{
+  if ( irx_cache )
+    return;
+  if ( ( irx_cache =
+         calloc( IRX_CACHE_BUCKETS, sizeof( irx_cache_entry_t * ) ) ) == NULL )
+    fatal_with_errno( "Cannot allocate the IRX cache" );
+}
+
+
+/*---------------------------------------------------------------------*/
+/*    irx_cache_key ...                                                */
+/*    -------------------------------------------------------------    */
+/*    Make a path absolute, and compute its bucket in the cache.       */
+/*---------------------------------------------------------------------*/
+static char *irx_cache_key( const char *irx, unsigned *bucket )
+{
+  char cwd[4096];
+  char *path;
+  unsigned h = 2166136261u;
+  const char *p;
+
+  if ( irx[0] == '/' )
+    cwd[0] = '\0';
+  else if ( getcwd( cwd, sizeof( cwd ) ) == NULL )
+    fatal_with_errno( "Could not get current working directory" );
+
+  if ( ( path = malloc( strlen( cwd ) + strlen( irx ) + 2 ) ) == NULL )
+    fatal_with_errno( "Cannot allocate memory" );
+  sprintf( path, cwd[0] ? "%s/%s" : "%s%s", cwd, irx );
+
+  for ( p = path; *p; p++ )
+    h = ( h ^ ( unsigned char ) *p ) * 16777619u;
+  *bucket = h % IRX_CACHE_BUCKETS;
+  return path;
+}
+
+
+/*---------------------------------------------------------------------*/
+/*    irx_cache_lookup ...                                             */
+/*    -------------------------------------------------------------    */
+/*    Fill an entry from the cache, if the IRX is there and its file   */
+/*    did not change. Returns 0 on a miss.                             */
+/*---------------------------------------------------------------------*/
+int irx_cache_lookup( const char *irx, struct stat *st, entry_t * entry )
+{
+  irx_cache_entry_t *c;
+  unsigned bucket;
+  char *path;
+
+  if ( !irx_cache )
+    return 0;
+
+  path = irx_cache_key( irx, &bucket );
+  pthread_mutex_lock( &irx_cache_lock );
+  for ( c = irx_cache[bucket]; c; c = c->next )
+    if ( strcmp( c->path, path ) == 0 )
+      break;
+  free( path );
+
+  if ( c == NULL || c->size != st->st_size || c->ino != st->st_ino ||
+       c->mtime.tv_sec != st->st_mtim.tv_sec ||
+       c->mtime.tv_nsec != st->st_mtim.tv_nsec ) {
+    pthread_mutex_unlock( &irx_cache_lock );
+    return 0;
+  }
+
+  *entry = c->entry;
+  irx_cache_touch( c );
+  pthread_mutex_unlock( &irx_cache_lock );
+  return 1;
+}
+
+
+/*---------------------------------------------------------------------*/
+/*    irx_cache_store ...                                              */
+/*    -------------------------------------------------------------    */
+/*    Remember a freshly loaded IRX. The cache takes ownership of      */
+/*    the IRX binary, replacing any outdated copy. The outdated        */
+/*    binary may still be used by the entries of an image being        */
+/*    built, so it is only released by irx_cache_collect, as are the   */
+/*    binaries evicted to make room for the new one.                   */
+/*---------------------------------------------------------------------*/
+void irx_cache_store( const char *irx, struct stat *st, entry_t * entry )
+{
+  irx_cache_entry_t *c, *fresh;
+  unsigned bucket;
+  char *path;
+
+  if ( !irx_cache )
+    return;
+
+  path = irx_cache_key( irx, &bucket );
+  if ( ( fresh = malloc( sizeof( irx_cache_entry_t ) ) ) == NULL )
+    fatal_with_errno( "Cannot allocate memory" );
+
+  pthread_mutex_lock( &irx_cache_lock );
+  for ( c = irx_cache[bucket]; c; c = c->next )
+    if ( strcmp( c->path, path ) == 0 )
+      break;
+
+  if ( c ) {
+    free( path );
+    free( fresh );
+    irx_cache_size -= irx_cache_entry_size( c );
+    if ( c->stripped && c->stripped != c->entry.irx_binary )
+      irx_cache_retire( c->stripped );
+    irx_cache_retire( c->entry.irx_binary );
+  } else {
+    c = fresh;
+    c->path = path;
+    c->bucket = bucket;
+    c->next = irx_cache[bucket];
+    c->older = c->newer = NULL;
+    irx_cache[bucket] = c;
+  }
+
+  c->size = st->st_size;
+  c->mtime = st->st_mtim;
+  c->ino = st->st_ino;
+  c->entry = *entry;
+  c->stripped = NULL;
+  irx_cache_size += irx_cache_entry_size( c );
+  irx_cache_touch( c );
+  irx_cache_evict( c );
+  pthread_mutex_unlock( &irx_cache_lock );
+}
+
+
+/*---------------------------------------------------------------------*/
+/*    irx_cache_find_loaded ...                                        */
+/*    -------------------------------------------------------------    */
+/*    Find the cached IRX whose binary an entry was filled with, with  */
+/*    the lock held. Returns NULL, with the lock released, if the IRX  */
+/*    is not cached or was loaded again since.                         */
+/*---------------------------------------------------------------------*/
+static irx_cache_entry_t *irx_cache_find_loaded( const char *irx,
+                                                 entry_t * entry )
+{
+  irx_cache_entry_t *c;
+  unsigned bucket;
+  char *path;
+
+  path = irx_cache_key( irx, &bucket );
+  pthread_mutex_lock( &irx_cache_lock );
+  for ( c = irx_cache[bucket]; c; c = c->next )
+    if ( strcmp( c->path, path ) == 0 )
+      break;
+  free( path );
+
+  if ( c == NULL || c->entry.irx_binary != entry->irx_binary ) {
+    pthread_mutex_unlock( &irx_cache_lock );
+    return NULL;
+  }
+  return c;
+}
+
+
+/*---------------------------------------------------------------------*/
+/*    irx_cache_lookup_stripped ...                                    */
+/*    -------------------------------------------------------------    */
+/*    Replace the binary of an entry filled by the cache with its      */
+/*    stripped copy, if the cache has one. Returns 0 on a miss.        */
+/*---------------------------------------------------------------------*/
+int irx_cache_lookup_stripped( const char *irx, entry_t * entry )
+{
+  irx_cache_entry_t *c;
+
+  if ( !irx_cache || ( c = irx_cache_find_loaded( irx, entry ) ) == NULL )
+    return 0;
+
+  if ( c->stripped == NULL ) {
+    pthread_mutex_unlock( &irx_cache_lock );
+    return 0;
+  }
+  entry->irx_binary = c->stripped;
+  entry->irx_size = c->stripped_size;
+  pthread_mutex_unlock( &irx_cache_lock );
+  return 1;
+}
+
+
+/*---------------------------------------------------------------------*/
+/*    irx_cache_store_stripped ...                                     */
+/*    -------------------------------------------------------------    */
+/*    Remember the stripped copy of the binary an entry was filled     */
+/*    with. The cache takes ownership of the copy, which is released   */
+/*    by irx_cache_collect if the cache does not keep it. Returns 0    */
+/*    when the cache is disabled: the caller then still owns both      */
+/*    binaries.                                                        */
+/*---------------------------------------------------------------------*/
+int irx_cache_store_stripped( const char *irx, entry_t * entry,
+                              char *stripped, int stripped_size )
+{
+  irx_cache_entry_t *c;
+
+  if ( !irx_cache )
+    return 0;
+
+  if ( ( c = irx_cache_find_loaded( irx, entry ) ) == NULL ) {
+    if ( stripped != entry->irx_binary ) {
+      pthread_mutex_lock( &irx_cache_lock );
+      irx_cache_retire( stripped );
+      pthread_mutex_unlock( &irx_cache_lock );
+    }
+    return 1;
+  }
+
+  // another thread may have stripped the same IRX in the meantime
+  if ( c->stripped == NULL ) {
+    c->stripped = stripped;
+    c->stripped_size = stripped_size;
+    if ( stripped != c->entry.irx_binary ) {
+      irx_cache_size += stripped_size;
+      irx_cache_touch( c );
+      irx_cache_evict( c );
+    }
+  } else if ( stripped != c->entry.irx_binary )
+    irx_cache_retire( stripped );
+  pthread_mutex_unlock( &irx_cache_lock );
+  return 1;
+}
+
+
+/*---------------------------------------------------------------------*/
+/*    irx_cache_collect ...                                            */
+/*    -------------------------------------------------------------    */
+/*    Release the binaries replaced in the cache. To be called when    */
+/*    no image is being built from entries filled by the cache.        */
+/*---------------------------------------------------------------------*/
+void irx_cache_collect(  )
+{
+  irx_cache_retired_t *r;
+
+  pthread_mutex_lock( &irx_cache_lock );
+  while ( ( r = irx_cache_retired ) != NULL ) {
+    irx_cache_retired = r->next;
+    free( r->binary );
+    free( r );
+  }
+  pthread_mutex_unlock( &irx_cache_lock );
+}
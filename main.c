@@ -33,6 +33,15 @@ char *version_string = "0.1";
 #define OP_LIST    3
 #define OP_DELETE  4
 #define OP_ADD     5
+#define OP_INSPECT 6
+#define OP_SERVE   7
+#define OP_APPLY   8
+#define OP_VARIANTS 9
+#define OP_MKPATCH 10
+#define OP_PATCH   11
+#define OP_PACK    12
+#define OP_UNPACK  13
+#define OP_PLAN    14
 
 extern void create_image( char *image_name, char *irx_args[], int num_irx );
 extern void extract_image( char *image_name, char *irx_args[], int num_irx );
@@ -41,9 +50,19 @@ extern void delete_entries_from_image( char *image_name, char *irx_args[],
 extern void add_entries_to_image( char *image_name, char *irx_args[],
                                   int num_irx );
 extern void list_image_entries( char *image_name );
+extern void inspect_irx_files( char *args[], int num_args );
+extern void serve_requests( char *socket_path );
+extern void apply_script( char *image_name, char *script );
+extern void build_variants( char *manifest );
+extern void watch_image( char *image_name, char *irx_args[], int num_irx );
+extern void make_patch( char *old_name, char *new_name, char *patch_name );
+extern void apply_patch( char *old_name, char *patch_name, char *new_name );
+extern void pack_images( char *pack_name, char *image_args[], int num_images );
+extern void unpack_images( char *pack_name, char *image_args[],
+                           int num_images, char *output );
+extern void plan_image( char *image_name, char *irx_args[], int num_irx,
+                        long max_size );
 
-char *program_name;
-int verbose;
 
 static struct option long_options[] = {
   {"help", no_argument, NULL, 'H'},
@@ -54,7 +73,27 @@ static struct option long_options[] = {
   {"append", no_argument, NULL, 'a'},
   {"list", no_argument, NULL, 't'},
   {"verbose", no_argument, NULL, 'v'},
+  {"gzip", no_argument, NULL, 'z'},
   {"file", required_argument, NULL, 'f'},
+  {"output", required_argument, NULL, 'o'},
+  {"inspect", no_argument, NULL, 'I'},
+  {"index", no_argument, NULL, 'N'},
+  {"serve", required_argument, NULL, 'S'},
+  {"reproducible", no_argument, NULL, 'R'},
+  {"romdir-descr", required_argument, NULL, 'D'},
+  {"cache", required_argument, NULL, 'C'},
+  {"store", required_argument, NULL, 'O'},
+  {"apply", required_argument, NULL, 'A'},
+  {"variants", required_argument, NULL, 'M'},
+  {"watch", no_argument, NULL, 'W'},
+  {"mkpatch", no_argument, NULL, 'P'},
+  {"patch", no_argument, NULL, 'Q'},
+  {"pack", no_argument, NULL, 'K'},
+  {"unpack", no_argument, NULL, 'U'},
+  {"plan", no_argument, NULL, 'L'},
+  {"strip", no_argument, NULL, 'T'},
+  {"trace", required_argument, NULL, 'G'},
+  {"max-size", required_argument, NULL, 'B'},
   {0, no_argument, 0, 0}
 };
 
@@ -76,6 +115,41 @@ void error_no_image_given(  )
          "Try `%s --help' for more information.\n", program_name );
 }
 
+void error_inspect_nothing(  )
+{
+  fatal( "You must give the IRX files or directories to inspect\n"
+         "Try `%s --help' for more information.\n", program_name );
+}
+
+/*---------------------------------------------------------------------*/
+/*    parse_size ...                                                   */
+/*    -------------------------------------------------------------    */
+/*    Parse a size in bytes, optionally followed by K or M.            */
+/*---------------------------------------------------------------------*/
+long parse_size( char *arg )
+{
+  char *end;
+  long size = strtol( arg, &end, 0 );
+  if ( *end == 'K' || *end == 'k' ) {
+    size *= 1024;
+    end++;
+  } else if ( *end == 'M' || *end == 'm' ) {
+    size *= 1024 * 1024;
+    end++;
+  }
+  if ( end == arg || *end || size <= 0 )
+    fatal( "Invalid size %s\n"
+           "Try `%s --help' for more information.\n", arg, program_name );
+  return size;
+}
+
+void error_patch_usage(  )
+{
+  fatal( "You must give the old ROM image and the %s\n"
+         "Try `%s --help' for more information.\n",
+         "new one, or the patch to apply", program_name );
+}
+
 void error_create_empty_archive(  )
 {
   fatal( "Refusing to create an empty archive\n"
@@ -98,6 +172,8 @@ void dump_help_and_exit(  )
       "  ps2img -cf rom.img bar gee # Create image rom.img from IRXs bar and gee.\n"
       "  ps2img -tf rom.img         # List all IRXs in image rom.img.\n"
       "  ps2img -xvf rom.img        # Extract all IRXs in image rom.img verbosely.\n"
+      "  ps2img --inspect irx/      # Catalog all IRXs found below directory irx.\n"
+      "  ps2img --serve /tmp/s      # Serve commands sent by ps2img-client.\n"
       "\n"
       "If a long option shows an argument as mandatory, then it is mandatory\n"
       "for the equivalent short option also.  Similarly for optional arguments.\n"
@@ -107,7 +183,67 @@ void dump_help_and_exit(  )
       "  -c, --create                Create a new ROM image\n"
       "  -a, --append                Append IRXs to the end of a ROM image\n"
       "  -d, --delete                Delete IRXs from the ROM image\n"
-      "  -f, --file=FILE             Use FILE as the ROM image\n" "\n"
+      "      --apply=SCRIPT          Apply the add, delete, replace and rename\n"
+      "                              operations listed in SCRIPT to the ROM\n"
+      "                              image, rewriting it only once\n"
+      "      --variants=MANIFEST     Create all the ROM images listed in\n"
+      "                              MANIFEST, one per line followed by its\n"
+      "                              IRXs, reading each IRX only once\n"
+      "  -f, --file=FILE             Use FILE as the ROM image\n"
+      "      --mkpatch OLD NEW       Write to the file given by -o the patch\n"
+      "                              turning ROM image OLD into NEW\n"
+      "      --patch OLD PATCH       Apply PATCH to ROM image OLD, in place or\n"
+      "                              into the file given by -o\n"
+      "      --plan IRX...           Print the layout -c would give to the ROM\n"
+      "                              image, reading only the IRX headers\n"
+      "                              unless --strip is given\n"
+      "      --max-size=SIZE         With --plan, fail if the ROM image would be\n"
+      "                              bigger than SIZE bytes (K and M suffixes)\n"
+      "      --pack IMG...           Store ROM images into the pack given by -f,\n"
+      "                              each distinct IRX only once; an image\n"
+      "                              compressed otherwise than ps2img would is\n"
+      "                              stored whole, to be unpacked unchanged\n"
+      "      --unpack [IMG...]       Rebuild ROM images from the pack given by\n"
+      "                              -f, or all of them\n"
+      "  -o, --output=FILE           Output file of --mkpatch and --patch, or\n"
+      "                              of --unpack with a single image\n"
+      "      --watch                 With -c, stay resident and create the ROM\n"
+      "                              image again whenever one of its IRXs\n"
+      "                              changes\n"
+      "  -z, --gzip                  Compress the ROM image with gzip. Images\n"
+      "                              named *.gz are always compressed, and\n"
+      "                              compressed images are read transparently\n"
+      "      --index                 Maintain an index IMAGE.idx of the ROM\n"
+      "                              image, used to speed up listing and\n"
+      "                              extraction while it is up to date\n"
+      "      --reproducible          Build byte-identical images from identical\n"
+      "                              IRXs: all dates are $SOURCE_DATE_EPOCH\n"
+      "                              (or the epoch) in UTC, and the ROMDIR\n"
+      "                              descriptor leaves out user, host and path\n"
+      "      --strip                 Drop the sections of the IRXs the IOP does\n"
+      "                              not load (.comment, .mdebug...); symbols\n"
+      "                              used by relocations are kept\n"
+      "      --trace=FILE            Save a timeline of the work done to FILE,\n"
+      "                              as Chrome trace events for Perfetto\n"
+      "      --romdir-descr=DESCR    Use DESCR as the ROMDIR descriptor\n"
+      "      --cache=DIR             Reuse images created before from the same\n"
+      "                              IRXs and options, kept in directory DIR\n"
+      "      --store=DIR             With -x, write each distinct IRX once into\n"
+      "                              directory DIR, named after its hash, and\n"
+      "                              extract the entries as hardlinks to it:\n"
+      "                              entries with the same contents share one\n"
+      "                              read-only file, so replace an extracted\n"
+      "                              entry rather than modifying it in place\n"
+      "      --inspect               Catalog name, version, size and header\n"
+      "                              fingerprint of IRX files or directories;\n"
+      "                              the fingerprint does not cover the code\n"
+      "      --serve=SOCKET          Stay resident and run the commands sent\n"
+      "                              by ps2img-client on the Unix socket\n"
+      "                              SOCKET, for the same user or root only,\n"
+      "                              caching up to 64MB of the IRXs they use;\n"
+      "                              an IRX is read from disk by the request\n"
+      "                              naming it first and by those running at\n"
+      "                              the time, and cached for later requests\n" "\n"
       "Informative output:\n"
       "  -H, --help                  Print this help, then exit\n"
       "  -V, --version               Print ps2img program version number\n"
@@ -116,17 +252,29 @@ void dump_help_and_exit(  )
   exit( 0 );
 }
 
-int main( int argc, char *argv[] )
+/*---------------------------------------------------------------------*/
+/*    run_command ...                                                  */
+/*    -------------------------------------------------------------    */
+/*    Parse a command line and run the requested operation. This is    */
+/*    also the entry point of the requests of the server mode.         */
+/*---------------------------------------------------------------------*/
+int run_command( int argc, char *argv[] )
 {
   char *img_file = NULL;
-  int opt_index;
+  char *output_file = NULL;
+  long max_size = 0;
+  char *socket_path = NULL;
+  char *script = NULL;
+  char *manifest = NULL;
+  int watch = 0;
   char c;
   int operation_mode = 0;
 
-  program_name = argv[0];
+  reset_options(  );
+  optind = 0;
 
   while ( ( c =
-            getopt_long( argc, argv, "adxctvf:", long_options,
+            getopt_long( argc, argv, "adxctvzf:o:", long_options,
                          NULL ) ) != -1 ) {
     switch ( c ) {
     case 'a':
@@ -154,12 +302,93 @@ int main( int argc, char *argv[] )
         error_invalid_operation_mode(  );
       operation_mode = OP_LIST;
       break;
+    case 'I':
+      if ( operation_mode )
+        error_invalid_operation_mode(  );
+      operation_mode = OP_INSPECT;
+      break;
+    case 'S':
+      if ( operation_mode )
+        error_invalid_operation_mode(  );
+      operation_mode = OP_SERVE;
+      socket_path = optarg;
+      break;
+    case 'A':
+      if ( operation_mode )
+        error_invalid_operation_mode(  );
+      operation_mode = OP_APPLY;
+      script = optarg;
+      break;
+    case 'M':
+      if ( operation_mode )
+        error_invalid_operation_mode(  );
+      operation_mode = OP_VARIANTS;
+      manifest = optarg;
+      break;
+    case 'P':
+      if ( operation_mode )
+        error_invalid_operation_mode(  );
+      operation_mode = OP_MKPATCH;
+      break;
+    case 'Q':
+      if ( operation_mode )
+        error_invalid_operation_mode(  );
+      operation_mode = OP_PATCH;
+      break;
+    case 'K':
+      if ( operation_mode )
+        error_invalid_operation_mode(  );
+      operation_mode = OP_PACK;
+      break;
+    case 'U':
+      if ( operation_mode )
+        error_invalid_operation_mode(  );
+      operation_mode = OP_UNPACK;
+      break;
+    case 'L':
+      if ( operation_mode )
+        error_invalid_operation_mode(  );
+      operation_mode = OP_PLAN;
+      break;
+    case 'B':
+      max_size = parse_size( optarg );
+      break;
     case 'f':
       img_file = optarg;
       break;
+    case 'o':
+      output_file = optarg;
+      break;
     case 'v':
       verbose = 1;
       break;
+    case 'z':
+      compress_image = 1;
+      break;
+    case 'N':
+      build_index = 1;
+      break;
+    case 'W':
+      watch = 1;
+      break;
+    case 'R':
+      reproducible = 1;
+      break;
+    case 'T':
+      strip_irxs = 1;
+      break;
+    case 'G':
+      trace_open( optarg );
+      break;
+    case 'D':
+      romdir_descr = optarg;
+      break;
+    case 'C':
+      cache_dir = optarg;
+      break;
+    case 'O':
+      store_dir = optarg;
+      break;
     case 'V':
       dump_version_and_exit(  );
       break;
@@ -172,9 +401,23 @@ int main( int argc, char *argv[] )
     }
   }
 
-  if ( !img_file )
+  if ( !img_file && operation_mode != OP_INSPECT &&
+       operation_mode != OP_SERVE && operation_mode != OP_VARIANTS &&
+       operation_mode != OP_MKPATCH && operation_mode != OP_PATCH )
     error_no_image_given(  );
 
+  if ( watch && operation_mode != OP_CREATE )
+    fatal( "`--watch' may only be used with `-c'\n"
+           "Try `%s --help' for more information.\n", program_name );
+
+  if ( store_dir && operation_mode != OP_EXTRACT )
+    fatal( "`--store' may only be used with `-x'\n"
+           "Try `%s --help' for more information.\n", program_name );
+
+  if ( max_size && operation_mode != OP_PLAN )
+    fatal( "`--max-size' may only be used with `--plan'\n"
+           "Try `%s --help' for more information.\n", program_name );
+
   switch ( operation_mode ) {
   case OP_EXTRACT:
     extract_image( img_file, &argv[optind], argc - optind );
@@ -182,9 +425,16 @@ int main( int argc, char *argv[] )
   case OP_CREATE:
     if ( optind == argc )
       error_create_empty_archive(  );
+    else if ( watch )
+      watch_image( img_file, &argv[optind], argc - optind );
     else
       create_image( img_file, &argv[optind], argc - optind );
     break;
+  case OP_PLAN:
+    if ( optind == argc )
+      error_create_empty_archive(  );
+    plan_image( img_file, &argv[optind], argc - optind, max_size );
+    break;
   case OP_DELETE:
     delete_entries_from_image( img_file, &argv[optind], argc - optind );
     break;
@@ -194,9 +444,49 @@ int main( int argc, char *argv[] )
   case OP_LIST:
     list_image_entries( img_file );
     break;
+  case OP_INSPECT:
+    if ( optind == argc )
+      error_inspect_nothing(  );
+    else
+      inspect_irx_files( &argv[optind], argc - optind );
+    break;
+  case OP_SERVE:
+    serve_requests( socket_path );
+    break;
+  case OP_APPLY:
+    apply_script( img_file, script );
+    break;
+  case OP_VARIANTS:
+    build_variants( manifest );
+    break;
+  case OP_MKPATCH:
+    if ( argc - optind != 2 || !output_file )
+      error_patch_usage(  );
+    make_patch( argv[optind], argv[optind + 1], output_file );
+    break;
+  case OP_PATCH:
+    if ( argc - optind != 2 )
+      error_patch_usage(  );
+    apply_patch( argv[optind], argv[optind + 1],
+                 output_file ? output_file : argv[optind] );
+    break;
+  case OP_PACK:
+    if ( optind == argc )
+      error_create_empty_archive(  );
+    pack_images( img_file, &argv[optind], argc - optind );
+    break;
+  case OP_UNPACK:
+    unpack_images( img_file, &argv[optind], argc - optind, output_file );
+    break;
   default:
     error_no_operation_mode(  );
   }
 
   return 0;
 }
+
+int main( int argc, char *argv[] )
+{
+  program_name = argv[0];
+  return run_command( argc, argv );
+}
@@ -0,0 +1,448 @@
+/**
+ * ps2img - Create, inspect or extract Playstation 2 ROM image files
+ * Copyright (c) 2005 Damien Ciabrini (dciabrin), Olivier Parra (yo6)
+ *
+ *     ps2img is free software; you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as
+ *     published by the Free Software Foundation; either version 2 of
+ *     the License, or (at your option) any later version.
+ *
+ *     ps2img is distributed in the hope that it will be useful, but
+ *     WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public
+ *     License along with ps2img; if not, write to the Free Software
+ *     Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *     02111-1307 USA
+ *
+ * $Id$
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+
+#include "common.h"
+#include "elf.h"
+
+extern romdir_t *create_romdir_section( entry_t * entry, int nb_entries );
+extern Elf32_Shdr *find_iopmod_section( char *irx, char *boot_elf, int size );
+extern int compact_image( char *img, entry_t * entry, int nb_entries );
+
+
+/*---------------------------------------------------------------------*/
+/*    Allocation accounting ...                                        */
+/*    -------------------------------------------------------------    */
+/*    The harness is linked with --wrap for the allocation functions,  */
+/*    so that the bytes allocated by the code under test are counted.  */
+/*---------------------------------------------------------------------*/
+static long long allocated_bytes;
+
+void *__real_malloc( size_t size );
+void *__real_calloc( size_t nmemb, size_t size );
+void *__real_realloc( void *ptr, size_t size );
+
+void *__wrap_malloc( size_t size )
+{
+  allocated_bytes += size;
+  return __real_malloc( size );
+}
+
+void *__wrap_calloc( size_t nmemb, size_t size )
+{
+  allocated_bytes += nmemb * size;
+  return __real_calloc( nmemb, size );
+}
+
+void *__wrap_realloc( void *ptr, size_t size )
+{
+  allocated_bytes += size;
+  return __real_realloc( ptr, size );
+}
+
+
+/*---------------------------------------------------------------------*/
+/*    Inputs ...                                                       */
+/*    -------------------------------------------------------------    */
+/*    Images and IRXs are generated in memory, so that no file I/O     */
+/*    is measured.                                                     */
+/*---------------------------------------------------------------------*/
+#define BENCH_IRX_SIZE 512
+
+typedef struct
+{
+  entry_t *entry;
+  int nb_entries;
+  romdir_t *romdir;
+  char *extinfo;
+  char *img;
+  char *work;
+  int img_size;
+  char *irx;
+  int irx_size;
+} input_t;
+
+static volatile int sink;
+
+
+/*---------------------------------------------------------------------*/
+/*    make_irx ...                                                     */
+/*    -------------------------------------------------------------    */
+/*    Build an ELF file with nb_sections sections, the last one        */
+/*    being .iopmod, the worst case for find_iopmod_section.           */
+/*---------------------------------------------------------------------*/
+static char *make_irx( int nb_sections, int *size )
+{
+  int strtab_off = sizeof( Elf32_Ehdr ) + 64;
+  int strtab_size = 16 * nb_sections;
+  int shoff = PAD4( strtab_off + strtab_size );
+  char *elf;
+  Elf32_Ehdr *eh;
+  Elf32_Shdr *sh;
+  int i, name = 1;
+
+  *size = shoff + nb_sections * sizeof( Elf32_Shdr );
+  elf = calloc( 1, *size );
+  eh = ( Elf32_Ehdr * ) elf;
+  memcpy( eh->e_ident, ELF_MAGIC, 4 );
+  eh->e_shoff = shoff;
+  eh->e_shentsize = sizeof( Elf32_Shdr );
+  eh->e_shnum = nb_sections;
+  eh->e_shstrndx = 1;
+
+  sh = ( Elf32_Shdr * ) ( elf + shoff );
+  for ( i = 1; i < nb_sections; i++ ) {
+    sh[i].sh_name = name;
+    if ( i == 1 ) {
+      strcpy( elf + strtab_off + name, ".shstrtab" );
+      sh[i].sh_offset = strtab_off;
+      sh[i].sh_size = strtab_size;
+    } else if ( i == nb_sections - 1 ) {
+      strcpy( elf + strtab_off + name, ".iopmod" );
+      sh[i].sh_offset = sizeof( Elf32_Ehdr );
+      sh[i].sh_size = 64;
+    } else
+      sprintf( elf + strtab_off + name, ".text%d", i );
+    name += strlen( elf + strtab_off + name ) + 1;
+  }
+  return elf;
+}
+
+
+/*---------------------------------------------------------------------*/
+/*    make_input ...                                                   */
+/*    -------------------------------------------------------------    */
+/*    Build an image of nb_irx IRXs, laid out as write_image does.     */
+/*---------------------------------------------------------------------*/
+static void make_input( input_t * in, int nb_irx )
+{
+  int i, off;
+
+  in->nb_entries = nb_irx + 3;
+  in->entry = calloc( in->nb_entries, sizeof( entry_t ) );
+  in->irx = make_irx( 8, &in->irx_size );
+
+  strcpy( in->entry[0].name, "RESET" );
+  in->entry[0].flags = ENTRY_FLAG_DATE;
+  strcpy( in->entry[1].name, "ROMDIR" );
+  in->entry[1].flags = ENTRY_FLAG_DESCR;
+  strcpy( in->entry[1].descr, "0000,bench,dummyconf,bench.img,ps2img" );
+  strcpy( in->entry[2].name, "EXTINFO" );
+  in->entry[2].flags = ENTRY_FLAG_NULL;
+  for ( i = 3; i < in->nb_entries; i++ ) {
+    entry_t *e = &in->entry[i];
+    sprintf( e->name, "M%d", i );
+    e->flags = ENTRY_FLAG_DATE | ENTRY_FLAG_VERSION | ENTRY_FLAG_DESCR;
+    e->date = 0x20051231;
+    e->version = 0x0101;
+    sprintf( e->descr, "Benchmark module %d", i );
+    e->irx_size = BENCH_IRX_SIZE;
+  }
+
+  in->romdir = create_romdir_section( in->entry, in->nb_entries );
+  in->extinfo = malloc( in->romdir[2].size );
+  for ( i = 0, off = 0; i < in->nb_entries; i++ )
+    off += extinfo_encode( &in->entry[i], in->extinfo + off );
+
+  off = PAD16( in->romdir[1].size + in->romdir[2].size );
+  for ( i = 3; i < in->nb_entries; i++ )
+    off = PAD16( off ) + BENCH_IRX_SIZE;
+  in->img_size = off;
+  in->img = calloc( 1, in->img_size );
+  in->work = malloc( in->img_size );
+  memcpy( in->img, in->romdir, in->romdir[1].size );
+  memcpy( in->img + in->romdir[1].size, in->extinfo, in->romdir[2].size );
+  off = PAD16( in->romdir[1].size + in->romdir[2].size );
+  for ( i = 3; i < in->nb_entries; i++ ) {
+    memset( in->img + off, i, BENCH_IRX_SIZE );
+    off = PAD16( off + BENCH_IRX_SIZE );
+  }
+}
+
+static void free_input( input_t * in )
+{
+  free( in->entry );
+  free( in->romdir );
+  free( in->extinfo );
+  free( in->img );
+  free( in->work );
+  free( in->irx );
+}
+
+
+/*---------------------------------------------------------------------*/
+/*    Operations ...                                                   */
+/*---------------------------------------------------------------------*/
+static void op_extinfo_size( input_t * in )
+{
+  int i, size = 0;
+  for ( i = 0; i < in->nb_entries; i++ )
+    size += extinfo_size( &in->entry[i] );
+  sink = size;
+}
+
+static void op_create_romdir_section( input_t * in )
+{
+  free( create_romdir_section( in->entry, in->nb_entries ) );
+}
+
+static void op_extinfo_encode( input_t * in )
+{
+  int i, off = 0;
+  for ( i = 0; i < in->nb_entries; i++ )
+    off += extinfo_encode( &in->entry[i], in->extinfo + off );
+}
+
+static void op_fill_entry_descriptors( input_t * in )
+{
+  entry_t *entry;
+  int nb_entries;
+  fill_entry_descriptors( "bench", in->img, in->img_size, &entry,
+                          &nb_entries );
+  free( entry );
+}
+
+// the entries to delete are marked once, each run compacts a fresh copy
+static void op_compact_image( input_t * in )
+{
+  memcpy( in->work, in->img, in->img_size );
+  sink = compact_image( in->work, in->entry, in->nb_entries );
+}
+
+static void op_find_iopmod_section( input_t * in )
+{
+  sink = find_iopmod_section( "bench", in->irx, in->irx_size )->sh_size;
+}
+
+
+/*---------------------------------------------------------------------*/
+/*    Measures ...                                                     */
+/*    -------------------------------------------------------------    */
+/*    An operation is repeated until a run lasts long enough, then     */
+/*    the best of several runs is kept to filter out noise.            */
+/*---------------------------------------------------------------------*/
+#define BENCH_MIN_RUN_NS 20000000LL
+#define BENCH_RUNS 10
+
+typedef struct
+{
+  char name[64];
+  double ns_per_op;
+  long long bytes_per_op;
+} result_t;
+
+static long long now_ns(  )
+{
+  struct timespec ts;
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void measure( result_t * r, void ( *op ) ( input_t * ), input_t * in )
+{
+  long long iterations = 1, start, elapsed, bytes;
+  long long i;
+  int run;
+
+  for ( ;; ) {
+    start = now_ns(  );
+    for ( i = 0; i < iterations; i++ )
+      op( in );
+    if ( now_ns(  ) - start >= BENCH_MIN_RUN_NS )
+      break;
+    iterations *= 2;
+  }
+
+  r->ns_per_op = -1;
+  for ( run = 0; run < BENCH_RUNS; run++ ) {
+    bytes = allocated_bytes;
+    start = now_ns(  );
+    for ( i = 0; i < iterations; i++ )
+      op( in );
+    elapsed = now_ns(  ) - start;
+    r->bytes_per_op = ( allocated_bytes - bytes ) / iterations;
+    if ( r->ns_per_op < 0 || r->ns_per_op > ( double ) elapsed / iterations )
+      r->ns_per_op = ( double ) elapsed / iterations;
+  }
+}
+
+
+/*---------------------------------------------------------------------*/
+/*    Baselines ...                                                    */
+/*    -------------------------------------------------------------    */
+/*    A baseline holds one line per benchmark: its name, ns/op and     */
+/*    bytes/op. Lines starting with # are ignored.                     */
+/*---------------------------------------------------------------------*/
+static result_t *read_baseline( char *name, int *nb )
+{
+  result_t *b = NULL;
+  char line[256];
+  FILE *f;
+  *nb = 0;
+  if ( ( f = fopen( name, "r" ) ) == NULL )
+    fatal_with_errno( "Cannot open file %s", name );
+  while ( fgets( line, sizeof( line ), f ) ) {
+    if ( line[0] == '#' || line[0] == '\n' )
+      continue;
+    b = realloc( b, ( *nb + 1 ) * sizeof( result_t ) );
+    if ( sscanf( line, "%63s %lf %lld", b[*nb].name, &b[*nb].ns_per_op,
+                 &b[*nb].bytes_per_op ) != 3 )
+      fatal( "%s: invalid line: %s", name, line );
+    ( *nb )++;
+  }
+  fclose( f );
+  return b;
+}
+
+static void write_baseline( char *name, result_t * r, int nb )
+{
+  FILE *f;
+  int i;
+  if ( ( f = fopen( name, "w" ) ) == NULL )
+    fatal_with_errno( "Cannot create file %s", name );
+  fprintf( f, "# ps2img microbenchmarks: name, ns/op, bytes/op\n"
+           "# Timings depend on the machine: regenerate this file with\n"
+           "# `make microbench-baseline' on the machine running the checks\n" );
+  for ( i = 0; i < nb; i++ )
+    fprintf( f, "%s %.1f %lld\n", r[i].name, r[i].ns_per_op,
+             r[i].bytes_per_op );
+  if ( fclose( f ) == -1 )
+    fatal_with_errno( "Cannot write file %s", name );
+}
+
+
+void dump_help_and_exit(  )
+{
+  printf( "Usage: %s [OPTION]... [BASELINE]\n"
+          "Run the ps2img microbenchmarks, and compare them to BASELINE.\n"
+          "\n"
+          "  -t PERCENT   Tolerated slowdown against the baseline (25)\n"
+          "  -w FILE      Save the results as a new baseline\n"
+          "\n"
+          "Exit status is 1 if a benchmark regressed.\n", program_name );
+  exit( 0 );
+}
+
+
+int main( int argc, char *argv[] )
+{
+  static int sizes[] = { 1, 16, 256, 4096 };
+  static int sections[] = { 4, 32, 256 };
+  static struct
+  {
+    char *name;
+    void ( *op ) ( input_t * );
+  } benchs[] = {
+    {"extinfo_size", op_extinfo_size},
+    {"create_romdir_section", op_create_romdir_section},
+    {"extinfo_encode", op_extinfo_encode},
+    {"fill_entry_descriptors", op_fill_entry_descriptors},
+    {"compact_image", op_compact_image},
+  };
+  int nb_benchs = sizeof( benchs ) / sizeof( benchs[0] );
+  int nb_sizes = sizeof( sizes ) / sizeof( sizes[0] );
+  int nb_sections = sizeof( sections ) / sizeof( sections[0] );
+  result_t *results, *baseline = NULL;
+  int nb_results = 0, nb_baseline = 0, regressions = 0;
+  double threshold = 25;
+  char *save = NULL;
+  input_t in;
+  int c, i, j;
+
+  program_name = argv[0];
+  while ( ( c = getopt( argc, argv, "ht:w:" ) ) != -1 ) {
+    switch ( c ) {
+    case 't':
+      threshold = atof( optarg );
+      break;
+    case 'w':
+      save = optarg;
+      break;
+    case 'h':
+      dump_help_and_exit(  );
+    default:
+      exit( 1 );
+    }
+  }
+  if ( optind < argc )
+    baseline = read_baseline( argv[optind], &nb_baseline );
+
+  results = calloc( nb_benchs * nb_sizes + nb_sections, sizeof( result_t ) );
+
+  // per image operations, from tiny images to thousands of entries
+  for ( j = 0; j < nb_sizes; j++ ) {
+    make_input( &in, sizes[j] );
+    for ( i = 3; i < in.nb_entries; i += 2 )
+      in.entry[i].name[0] = -1;
+    for ( i = 0; i < nb_benchs; i++ ) {
+      result_t *r = &results[nb_results++];
+      sprintf( r->name, "%s/%d", benchs[i].name, sizes[j] );
+      measure( r, benchs[i].op, &in );
+    }
+    free_input( &in );
+  }
+
+  // the .iopmod search, from a few sections to hundreds
+  for ( j = 0; j < nb_sections; j++ ) {
+    result_t *r = &results[nb_results++];
+    memset( &in, 0, sizeof( in ) );
+    in.irx = make_irx( sections[j], &in.irx_size );
+    sprintf( r->name, "find_iopmod_section/%d", sections[j] );
+    measure( r, op_find_iopmod_section, &in );
+    free( in.irx );
+  }
+
+  printf( "%-32s %12s %10s %10s\n", "BENCHMARK", "ns/op", "bytes/op",
+          "BASELINE" );
+  for ( i = 0; i < nb_results; i++ ) {
+    result_t *r = &results[i];
+    printf( "%-32s %12.1f %10lld ", r->name, r->ns_per_op,
+            r->bytes_per_op );
+    for ( j = 0; j < nb_baseline; j++ )
+      if ( strcmp( baseline[j].name, r->name ) == 0 )
+        break;
+    if ( j == nb_baseline ) {
+      printf( "%10s\n", baseline ? "new" : "-" );
+      continue;
+    }
+    printf( "%+9.1f%%", 100 * ( r->ns_per_op / baseline[j].ns_per_op - 1 ) );
+    if ( r->ns_per_op > baseline[j].ns_per_op * ( 1 + threshold / 100 ) ||
+         r->bytes_per_op >
+         baseline[j].bytes_per_op * ( 1 + threshold / 100 ) ) {
+      printf( "  REGRESSION" );
+      regressions++;
+    }
+    printf( "\n" );
+  }
+
+  if ( save )
+    write_baseline( save, results, nb_results );
+  if ( regressions )
+    fatal( "%d benchmarks regressed by more than %.0f%%", regressions,
+           threshold );
+  return 0;
+}
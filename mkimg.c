@@ -26,39 +26,20 @@
 
 #include "common.h"
 #include "elf.h"
+#include "sha256.h"
 
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
 
-/*---------------------------------------------------------------------*/
-/*    get_entry_extinfo_size                                           */
-/*    -------------------------------------------------------------    */
-/*    Compute the size this entry would take in the extinfo section    */
-/*---------------------------------------------------------------------*/
-static int get_entry_extinfo_size( entry_t * entry )
-{
-  int size = 0;
-  if ( entry->flags & ENTRY_FLAG_DATE )
-    size += sizeof( extinfo_t ) + 4;
-  if ( entry->flags & ENTRY_FLAG_VERSION )
-    size += sizeof( extinfo_t );
-  if ( entry->flags & ENTRY_FLAG_DESCR )
-    size += sizeof( extinfo_t ) + PAD4( strlen( entry->descr ) + 1 );
-  if ( entry->flags & ENTRY_FLAG_NULL )
-    size += sizeof( extinfo_t ) + 4;
-  return size;
-}
-
-
 /*---------------------------------------------------------------------*/
 /*    create_romdir_section ...                                        */
 /*    -------------------------------------------------------------    */
 /*    Build a raw ROMDIR section, given a list of ROM entries.         */
 /*    The raw data is eventually saved to disk.                        */
 /*---------------------------------------------------------------------*/
-static romdir_t *create_romdir_section( entry_t * entry, int nb_entries )
+romdir_t *create_romdir_section( entry_t * entry, int nb_entries )
 {
   int i;
 
@@ -91,7 +72,7 @@ static romdir_t *create_romdir_section( entry_t * entry, int nb_entries )
   // Fill file attributes and size of user entries  
   for ( i = 0; i < nb_entries; i++ ) {
     // get the extinfo_size of this entry
-    romdir[i].extinfo_size = get_entry_extinfo_size( &entry[i] );
+    romdir[i].extinfo_size = extinfo_size( &entry[i] );
     // Update EXTINFO section's size
     romdir[2].size += romdir[i].extinfo_size;
   }
@@ -99,116 +80,132 @@ static romdir_t *create_romdir_section( entry_t * entry, int nb_entries )
   entry[0].irx_size = romdir[0].size;
   entry[1].irx_size = romdir[1].size;
   entry[2].irx_size = romdir[2].size;
+  entry[0].irx_offset = 0;
+  entry[1].irx_offset = 0;
+  entry[2].irx_offset = romdir[1].size;
 
   return romdir;
 }
 
 
 /*---------------------------------------------------------------------*/
-/*    create_extinfo_section ...                                       */
+/*    find_iopmod_section                                              */
 /*    -------------------------------------------------------------    */
-/*    Build a raw EXTINFO section, given a list of ROM entries and     */
-/*    a ROMDIR section. The raw data is eventually saved to disk.      */
+/*    Locate the .iopmod section of an IRX loaded in memory, making    */
+/*    sure the ELF headers we walk through lie within the file.        */
 /*---------------------------------------------------------------------*/
-static char *create_extinfo_section( char *bytes, entry_t * entry,
-                                     int nb_entries )
+Elf32_Shdr *find_iopmod_section( char *irx, char *boot_elf, int size )
 {
+  Elf32_Ehdr *eh = ( Elf32_Ehdr * ) boot_elf;
+  Elf32_Shdr *esh;
+  char *sh_str_table;
+  int strtab_size;
   int i;
-  int off = 0;
-  extinfo_t *inf;
-
-  for ( i = 0; i < nb_entries; i++ ) {
-    if ( entry[i].flags & ENTRY_FLAG_DATE ) {
-      inf = ( extinfo_t * ) ( bytes + off );
-      inf->value = 0;
-      inf->size = 4;
-      inf->id = EXTINFO_ID_DATE;
-      off += sizeof( extinfo_t );
-      *( unsigned * ) ( bytes + off ) = entry[i].date;
-      off += inf->size;
-    }
 
-    if ( entry[i].flags & ENTRY_FLAG_VERSION ) {
-      inf = ( extinfo_t * ) ( bytes + off );
-      inf->value = entry[i].version;
-      inf->size = 0;
-      inf->id = EXTINFO_ID_VERSION;
-      off += sizeof( extinfo_t );
-    }
-
-    if ( entry[i].flags & ENTRY_FLAG_DESCR ) {
-      inf = ( extinfo_t * ) ( bytes + off );
-      inf->value = 0;
-      inf->size = PAD4( strlen( entry[i].descr ) + 1 );
-      inf->id = EXTINFO_ID_DESCR;
-      off += sizeof( extinfo_t );
-      memset( bytes + off, 0, inf->size );
-      strcpy( bytes + off, entry[i].descr );
-      off += inf->size;
-    }
+  if ( size < sizeof( Elf32_Ehdr ) ||
+       memcmp( eh->e_ident, ELF_MAGIC, 4 ) != 0 ||
+       eh->e_shentsize != sizeof( Elf32_Shdr ) ||
+       eh->e_shstrndx >= eh->e_shnum ||
+       eh->e_shoff > size ||
+       eh->e_shnum * sizeof( Elf32_Shdr ) > size - eh->e_shoff )
+    fatal( "Invalid IRX %s: not an ELF file.", irx );
+
+  esh = ( Elf32_Shdr * ) ( boot_elf + eh->e_shoff );
+  sh_str_table = boot_elf + esh[eh->e_shstrndx].sh_offset;
+  strtab_size = esh[eh->e_shstrndx].sh_size;
+  if ( esh[eh->e_shstrndx].sh_offset > size ||
+       strtab_size > size - esh[eh->e_shstrndx].sh_offset )
+    fatal( "Invalid IRX %s: corrupted section names.", irx );
 
-    if ( entry[i].flags & ENTRY_FLAG_NULL ) {
-      inf = ( extinfo_t * ) ( bytes + off );
-      inf->value = 0;
-      inf->size = 4;
-      inf->id = EXTINFO_ID_NULL;
-      off += sizeof( extinfo_t );
-      memset( bytes + off, 0, inf->size );
-      off += inf->size;
-    }
-  }
-
-  return bytes;
+  // search for the start of section .iopmod in the elf
+  i = iopmod_section_index( esh, eh->e_shnum, sh_str_table, strtab_size );
+  if ( i == -1 )
+    fatal( "Invalid IRX %s: .iopmod section not found.", irx );
+  if ( esh[i].sh_offset > size || esh[i].sh_size > size - esh[i].sh_offset )
+    fatal( "Invalid IRX %s: .iopmod section out of file.", irx );
+  return &esh[i];
 }
 
 
 /*---------------------------------------------------------------------*/
-/*    init_entry_from_irx                                              */
+/*    load_entry_from_irx                                              */
 /*    -------------------------------------------------------------    */
-/*    Load an IRX into memory and fill a ROM file entry element.       */
+/*    Load an IRX into memory and fill a ROM file entry element,       */
+/*    named name.                                                      */
 /*---------------------------------------------------------------------*/
-void init_entry_from_irx( entry_t * entry, char *irx )
+void load_entry_from_irx( entry_t * entry, char *irx, char *name )
 {
   struct stat st;
-  read_file( irx, &entry->irx_binary, &entry->irx_size );
+  Elf32_Shdr *iopmod;
+
+  if ( strlen( name ) > 9 )
+    fatal( "invalid ROM file entry %s: name too long", name );
 
   if ( stat( irx, &st ) == -1 )
     fatal_with_errno( "Cannot stat file %s", irx );
 
-  irx = basename( irx );
-  if ( strlen( irx ) > 9 )
-    fatal( "invalid ROM file entry %s: name too long" );
-  else
-    strcpy( entry->name, irx );
+  if ( irx_cache_lookup( irx, &st, entry ) ) {
+    strcpy( entry->name, name );
+    return;
+  }
+
+  read_file( irx, &entry->irx_binary, &entry->irx_size );
+  cleanup_push( free_indirect, &entry->irx_binary );
+
+  strcpy( entry->name, name );
 
   entry->date = time_t_to_hexa( &st.st_mtime );
 
   entry->flags = ENTRY_FLAG_DATE | ENTRY_FLAG_VERSION | ENTRY_FLAG_DESCR;
+  entry->descr_view = NULL;
+  entry->raw_extinfo = NULL;
+
+  TRACE_BEGIN( "parse_irx", irx );
+  iopmod = find_iopmod_section( irx, entry->irx_binary, entry->irx_size );
+  if ( !parse_iopmod_section( entry->irx_binary + iopmod->sh_offset,
+                              iopmod->sh_size, &entry->version,
+                              entry->descr, sizeof( entry->descr ) ) )
+    fatal( "Invalid IRX %s: .iopmod section too short.", irx );
+  TRACE_END( "parse_irx" );
+  cleanup_pop( 0 );
+
+  irx_cache_store( irx, &st, entry );
+}
 
-  char *boot_elf = ( char * ) entry->irx_binary;
-  Elf32_Ehdr *eh = ( Elf32_Ehdr * ) boot_elf;
-  Elf32_Shdr *esh = ( Elf32_Shdr * ) ( boot_elf + eh->e_shoff );
-  char *sh_str_table = boot_elf + esh[eh->e_shstrndx].sh_offset;
-  int i;
 
-  // search for the start of section .iopmod in the elf
-  // don't search in the first section descriptor as it is a dummy
-  for ( i = 1; i < eh->e_shnum; i++ ) {
-    if ( strcmp( sh_str_table + esh[i].sh_name, ".iopmod" ) == 0 ) {
-      char *iopmodsec = ( char * ) ( boot_elf + esh[i].sh_offset );
-      // We skip the first 24 bytes of the section. it contains:
-      // [4 bytes] a magic word
-      // [4 bytes] the IRX's start address
-      // [4 bytes] the value of the GP register
-      // [4 bytes] the size of the .text section
-      // [4 bytes] the size of the .data section
-      // [4 bytes] the size of the .bss section
-      entry->version = ( *( iopmodsec + 24 ) << 8 ) + *( iopmodsec + 25 );
-      strcpy( entry->descr, iopmodsec + 26 );
-      return;
-    }
+/*---------------------------------------------------------------------*/
+/*    init_named_entry_from_irx                                        */
+/*    -------------------------------------------------------------    */
+/*    Same as load_entry_from_irx, but the sections of the IRX the     */
+/*    IOP does not need are dropped if asked to. The cache keeps the   */
+/*    IRX as it is on disk, along with its stripped copy.              */
+/*---------------------------------------------------------------------*/
+void init_named_entry_from_irx( entry_t * entry, char *irx, char *name )
+{
+  load_entry_from_irx( entry, irx, name );
+  if ( strip_irxs && !irx_cache_lookup_stripped( irx, entry ) ) {
+    int size = entry->irx_size;
+    TRACE_BEGIN( "strip_irx", irx );
+    char *stripped = strip_irx( irx, entry->irx_binary, &size );
+    TRACE_END( "strip_irx" );
+    // without the cache, nothing holds the IRX as it is on disk
+    if ( !irx_cache_store_stripped( irx, entry, stripped, size ) &&
+         stripped != entry->irx_binary )
+      free( entry->irx_binary );
+    entry->irx_binary = stripped;
+    entry->irx_size = size;
   }
-  fatal( "Invalid IRX %s: .iopmod section not found.", irx );
+}
+
+
+/*---------------------------------------------------------------------*/
+/*    init_entry_from_irx                                              */
+/*    -------------------------------------------------------------    */
+/*    Fill an entry named after the file of its IRX.                   */
+/*---------------------------------------------------------------------*/
+void init_entry_from_irx( entry_t * entry, char *irx )
+{
+  init_named_entry_from_irx( entry, irx, basename( irx ) );
 }
 
 
@@ -222,9 +219,28 @@ void init_entry_from_irx( entry_t * entry, char *irx )
 /*          * The name of the ROM image,                               */
 /*          * The name of the user that created the image,             */
 /*          * The host and path where the image is being built.        */
+/*    Reproducible builds use the descriptor given by the user, or a   */
+/*    descriptor that does not depend on the build environment.        */
 /*---------------------------------------------------------------------*/
 void make_romdir_description( char *img_name, entry_t * entry, time_t * time )
 {
+  struct tm m;
+
+  if ( romdir_descr ) {
+    snprintf( entry->descr, sizeof( entry->descr ), "%s", romdir_descr );
+    return;
+  }
+
+  time_to_tm( time, &m );
+
+  if ( reproducible ) {
+    snprintf( entry->descr, sizeof( entry->descr ),
+              "%x-%02d%02d%02d,dummyconf,%s,ps2img@reproducible",
+              time_t_to_hexa( time ), m.tm_hour, m.tm_min, m.tm_sec,
+              basename( img_name ) );
+    return;
+  }
+
   char path[200];
   char host[200];
   char *home = getenv( "HOME" );
@@ -241,9 +257,6 @@ void make_romdir_description( char *img_name, entry_t * entry, time_t * time )
   else
     loc = path;
 
-  struct tm m;
-  localtime_r( time, &m );
-
   // generate the 4 elements description string
   snprintf( entry->descr, sizeof( entry->descr ),
             "%x-%02d%02d%02d,dummyconf,%s,%s@%s%s",
@@ -270,6 +283,32 @@ void verbose_print_add_message( const char *irx, int size )
 char zeros_buffer[16];
 
 
+/*---------------------------------------------------------------------*/
+/*    init_meta_entries                                                */
+/*    -------------------------------------------------------------    */
+/*    Fill the RESET, ROMDIR and EXTINFO entries of a new image.       */
+/*---------------------------------------------------------------------*/
+void init_meta_entries( char *image_name, entry_t * entry, time_t * curtime )
+{
+  // Init first meta-entry
+  strcpy( entry[0].name, "RESET" );
+  entry[0].flags = ENTRY_FLAG_DATE;
+  entry[0].date = time_t_to_hexa( curtime );
+
+  // Init second meta-entry
+  strcpy( entry[1].name, "ROMDIR" );
+  entry[1].flags = ENTRY_FLAG_DESCR;
+  make_romdir_description( image_name, &entry[1], curtime );
+
+  // Init third meta-entry
+  strcpy( entry[2].name, "EXTINFO" );
+  entry[2].flags = ENTRY_FLAG_NULL;
+
+  entry[0].raw_extinfo = entry[1].raw_extinfo = entry[2].raw_extinfo = NULL;
+  entry[0].descr_view = entry[1].descr_view = entry[2].descr_view = NULL;
+}
+
+
 /*---------------------------------------------------------------------*/
 /*    create_image                                                     */
 /*    -------------------------------------------------------------    */
@@ -285,82 +324,141 @@ void create_image( char *image_name, char *irx_args[], int num_irx )
   if ( ( entry = malloc( sizeof( entry_t ) * nb_entries ) ) == NULL )
     fatal_with_errno( "Cannot allocate %d bytes of memory",
                       sizeof( entry_t ) * nb_entries );
+  cleanup_push( free_indirect, &entry );
+
+  // Get current time for meta entries
+  time_t curtime = build_time(  );
 
   for ( i = 0; i < num_irx; i++ ) {
     init_entry_from_irx( &entry[i + 3], irx_args[i] );
+    // reproducible builds ignore the modification time of the IRXs
+    if ( reproducible )
+      entry[i + 3].date = time_t_to_hexa( &curtime );
     if ( size < entry[i + 3].irx_size )
       size = entry[i + 3].irx_size;
   }
-  verbose_set_length_of_size_column( digits_in_number( size ) );
-
-  // Get current time for meta entries
-  time_t curtime;
-  time( &curtime );
 
-  // Init first meta-entry
-  strcpy( entry[0].name, "RESET" );
-  entry[0].flags = ENTRY_FLAG_DATE;
-  entry[0].date = time_t_to_hexa( &curtime );
+  init_meta_entries( image_name, entry, &curtime );
 
-  // Init second meta-entry
-  strcpy( entry[1].name, "ROMDIR" );
-  entry[1].flags = ENTRY_FLAG_DESCR;
-  make_romdir_description( image_name, &entry[1], &curtime );
-
-  // Init third meta-entry
-  strcpy( entry[2].name, "EXTINFO" );
-  entry[2].flags = ENTRY_FLAG_NULL;
-
-  // Dump filesystem info
+  // Dump filesystem info, the format being shared by all threads
   if ( verbose ) {
+    verbose_set_length_of_size_column( digits_in_number( size ) );
     printf( "Creating ROM image %s with the following entries:\n",
             image_name );
     verbose_display_header(  );
   }
+
+  image_lock( image_name );
+  write_image( image_name, entry, nb_entries,
+               image_compression( image_name, COMPRESS_NONE ) );
+  image_unlock(  );
+  cleanup_pop( 1 );
+}
+
+
+/*---------------------------------------------------------------------*/
+/*    layout_image                                                     */
+/*    -------------------------------------------------------------    */
+/*    Set the offsets of the IRXs, which follow the ROMDIR and         */
+/*    EXTINFO sections, each one aligned on 16 bytes. Return the       */
+/*    size of the image.                                               */
+/*---------------------------------------------------------------------*/
+int layout_image( entry_t * entry, int nb_entries, romdir_t * romdir )
+{
+  int off = romdir[1].size + romdir[2].size;
+  int i;
+  for ( i = 3; i < nb_entries; i++ ) {
+    entry[i].irx_offset = PAD16( off );
+    off = entry[i].irx_offset + entry[i].irx_size;
+  }
+  return off;
+}
+
+
+/*---------------------------------------------------------------------*/
+/*    write_image                                                      */
+/*    -------------------------------------------------------------    */
+/*    Save a ROM image to disk, given all its entries, including the   */
+/*    RESET, ROMDIR and EXTINFO meta-entries. The image is written     */
+/*    to a temporary file which then replaces the previous one.        */
+/*---------------------------------------------------------------------*/
+void write_image( char *image_name, entry_t * entry, int nb_entries,
+                  int compression )
+{
+  int i;
+
   // Create ROMDIR
+  TRACE_BEGIN( "create_romdir_section", NULL );
   romdir_t *romdir = create_romdir_section( entry, nb_entries );
-
-  // Create EXTINFO
-  char *bytes;
-  if ( ( bytes = malloc( romdir[2].size ) ) == NULL )
-    fatal_with_errno( "Cannot allocate %d bytes of memory", romdir[2].size );
-  char *extinfo = create_extinfo_section( bytes, entry, nb_entries );
+  TRACE_END( "create_romdir_section" );
+  cleanup_push( free_indirect, &romdir );
+
+  // Lay out the IRXs after the ROMDIR and EXTINFO sections
+  layout_image( entry, nb_entries, romdir );
+
+  // Reuse an identical image built before, if any
+  unsigned char key[SHA256_SIZE];
+  if ( cache_dir ) {
+    image_cache_key( entry, nb_entries, compression, key );
+    if ( image_cache_fetch( image_name, key ) ) {
+      if ( verbose ) {
+        for ( i = 0; i < nb_entries; i++ )
+          verbose_dump_entry_info( &entry[i] );
+        printf( "Image found in cache %s\n", cache_dir );
+      }
+      if ( index_wanted( image_name ) )
+        index_write( image_name, entry, nb_entries, compression );
+      cleanup_pop( 1 );
+      return;
+    }
+  }
 
   // Create IMG file
-  int off = 0;
-  FILE *f;
-  if ( ( f = fopen( image_name, "w" ) ) == NULL )
-    fatal_with_errno( "Could not create ROM image %s\n", image_name );
+  TRACE_BEGIN( "write_image", image_name );
+  ostream_t *f = ostream_open_atomic( image_name, compression );
 
   // Write ROMDIR
-  fwrite( romdir, romdir[1].size, 1, f );
-  off += romdir[1].size;
+  TRACE_BEGIN( "write_romdir", NULL );
+  ostream_write( f, romdir, romdir[1].size );
+  TRACE_END( "write_romdir" );
+  int off = romdir[1].size;
   if ( verbose ) {
     verbose_dump_entry_info( &entry[0] );
     verbose_dump_entry_info( &entry[1] );
   }
-  // Write EXTINFO
-  fwrite( extinfo, romdir[2].size, 1, f );
+  // Write EXTINFO, encoding the records straight into the stream
+  TRACE_BEGIN( "write_extinfo", NULL );
+  for ( i = 0; i < nb_entries; i++ ) {
+    char *out = ostream_reserve( f, romdir[i].extinfo_size );
+    ostream_commit( f, extinfo_encode( &entry[i], out ) );
+  }
+  TRACE_END( "write_extinfo" );
   off += romdir[2].size;
   if ( verbose )
     verbose_dump_entry_info( &entry[2] );
 
   // Write files
   for ( i = 3; i < nb_entries; i++ ) {
+    TRACE_BEGIN( "write_entry", entry[i].name );
     // Pad with zeroes if necessary
-    if ( off & 0xF ) {
-      int toWrite = 0x10 - ( off & 0xF );
-      fwrite( zeros_buffer, toWrite, 1, f );
-      off += toWrite;
-    }
-    fwrite( entry[i].irx_binary, 1, entry[i].irx_size, f );
-    off += entry[i].irx_size;
+    ostream_write( f, zeros_buffer, entry[i].irx_offset - off );
+    ostream_write( f, entry[i].irx_binary, entry[i].irx_size );
+    off = entry[i].irx_offset + entry[i].irx_size;
+    TRACE_END( "write_entry" );
 
     if ( verbose )
       verbose_dump_entry_info( &entry[i] );
   }
 
-  fclose( f );
+  ostream_close( f );
+  TRACE_END( "write_image" );
+  cleanup_pop( 1 );
+
+  if ( cache_dir )
+    image_cache_store( image_name, key );
+
+  if ( index_wanted( image_name ) )
+    index_write( image_name, entry, nb_entries, compression );
 }
 
 
@@ -373,8 +471,9 @@ void inner_add_entries( char *image_name, entry_t entries[], int num_entries )
 {
   // Read the entire file
   char *img;
-  int size, i, j;
-  read_file( image_name, &img, &size );
+  int size, i, j, compression;
+  image_lock( image_name );
+  read_file_compressed( image_name, &img, &size, &compression );
 
   romdir_t *romdir_entry = ( romdir_t * ) img;
 
@@ -409,7 +508,7 @@ void inner_add_entries( char *image_name, entry_t entries[], int num_entries )
   for ( i = 0; i < num_entries; i++ ) {
     new_romdir_size += sizeof( romdir_t );
     new_extinfo_size =
-      PAD4( new_extinfo_size ) + get_entry_extinfo_size( &entries[i] );
+      PAD4( new_extinfo_size ) + extinfo_size( &entries[i] );
     new_irx_size = PAD16( new_irx_size ) + entries[i].irx_size;
   }
 
@@ -436,8 +535,7 @@ void inner_add_entries( char *image_name, entry_t entries[], int num_entries )
   for ( i = 0; i < num_entries; i++ ) {
     memset( img + offset, 0, PAD4( offset ) - offset );
     offset = PAD4( offset );
-    create_extinfo_section( img + offset, &entries[i], 1 );
-    offset += get_entry_extinfo_size( &entries[i] );
+    offset += extinfo_encode( &entries[i], img + offset );
   }
   // pad up to the next section
   memset( img + offset, 0, PAD16( offset ) - offset );
@@ -448,7 +546,7 @@ void inner_add_entries( char *image_name, entry_t entries[], int num_entries )
     romdir_t romdir_entry;
     memset( &romdir_entry, 0, sizeof( romdir_t ) );
     strcpy( romdir_entry.name, entries[i].name );
-    romdir_entry.extinfo_size = get_entry_extinfo_size( &entries[i] );
+    romdir_entry.extinfo_size = extinfo_size( &entries[i] );
     romdir_entry.size = entries[i].irx_size;
     memcpy( img + offset, &romdir_entry, sizeof( romdir_t ) );
     offset += sizeof( romdir_t );
@@ -463,7 +561,17 @@ void inner_add_entries( char *image_name, entry_t entries[], int num_entries )
   romdir_entry[2].size = new_extinfo_size;
 
   // done ! save the result to disk
-  write_file( image_name, img, new_total_size );
+  compression = image_compression( image_name, compression );
+  write_file_compressed( image_name, img, new_total_size, compression );
+
+  if ( index_wanted( image_name ) ) {
+    entry_t *new_entry;
+    int nb_new_entries;
+    fill_entry_descriptors( image_name, img, new_total_size, &new_entry,
+                            &nb_new_entries );
+    index_write( image_name, new_entry, nb_new_entries, compression );
+  }
+  image_unlock(  );
 }
 
 
@@ -475,9 +583,12 @@ void inner_add_entries( char *image_name, entry_t entries[], int num_entries )
 void add_entries_to_image( char *image_name, char *irx_args[], int num_irx )
 {
   entry_t entries[num_irx];
+  time_t curtime = build_time(  );
   int i;
   for ( i = 0; i < num_irx; i++ ) {
     init_entry_from_irx( &entries[i], irx_args[i] );
+    if ( reproducible )
+      entries[i].date = time_t_to_hexa( &curtime );
   }
   inner_add_entries( image_name, entries, num_irx );
 }
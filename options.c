@@ -0,0 +1,61 @@
+/**
+ * ps2img - Create, inspect or extract Playstation 2 ROM image files
+ * Copyright (c) 2005 Damien Ciabrini (dciabrin), Olivier Parra (yo6)
+ *
+ *     ps2img is free software; you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as
+ *     published by the Free Software Foundation; either version 2 of
+ *     the License, or (at your option) any later version.
+ *
+ *     ps2img is distributed in the hope that it will be useful, but
+ *     WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public
+ *     License along with ps2img; if not, write to the Free Software
+ *     Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *     02111-1307 USA
+ *
+ * $Id$
+ */
+
+#include <stdlib.h>
+#include "common.h"
+
+
+/*---------------------------------------------------------------------*/
+/*    Options ...                                                      */
+/*    -------------------------------------------------------------    */
+/*    The options of the command being run, shared by all modules.     */
+/*    They are defined apart from main, so that the microbenchmarks    */
+/*    link the same modules without a main of their own.               */
+/*---------------------------------------------------------------------*/
+char *program_name;
+int verbose;
+int compress_image;
+int build_index;
+int reproducible;
+char *romdir_descr;
+char *cache_dir;
+char *store_dir;
+int strip_irxs;
+
+
+/*---------------------------------------------------------------------*/
+/*    reset_options ...                                                */
+/*    -------------------------------------------------------------    */
+/*    Give the options their default values before a command line is   */
+/*    parsed.                                                          */
+/*---------------------------------------------------------------------*/
+void reset_options(  )
+{
+  verbose = 0;
+  compress_image = 0;
+  build_index = 0;
+  reproducible = 0;
+  romdir_descr = NULL;
+  cache_dir = NULL;
+  store_dir = NULL;
+  strip_irxs = 0;
+}
@@ -0,0 +1,517 @@
+/**
+ * ps2img - Create, inspect or extract Playstation 2 ROM image files
+ * Copyright (c) 2005 Damien Ciabrini (dciabrin), Olivier Parra (yo6)
+ *
+ *     ps2img is free software; you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as
+ *     published by the Free Software Foundation; either version 2 of
+ *     the License, or (at your option) any later version.
+ *
+ *     ps2img is distributed in the hope that it will be useful, but
+ *     WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public
+ *     License along with ps2img; if not, write to the Free Software
+ *     Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *     02111-1307 USA
+ *
+ * $Id$
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "common.h"
+#include "sha256.h"
+
+
+/*---------------------------------------------------------------------*/
+/*    Pack layout:                                                     */
+/*    -------------------------------------------------------------    */
+/*    A pack stores many images, each distinct IRX only once. Every    */
+/*    image is kept as its head, that is its ROMDIR and EXTINFO        */
+/*    sections and their padding, and the list of its IRXs. An         */
+/*    image is rebuilt with the layout of write_image: each IRX is     */
+/*    aligned on 16 bytes and padded with zeroes.                      */
+/*      [8 bytes]  magic                                               */
+/*      [...]      IRXs and image heads, in any order                  */
+/*      [...]      the index                                           */
+/*      [8 bytes]  offset of the index                                 */
+/*      [4 bytes]  size of the index                                   */
+/*      [8 bytes]  magic                                               */
+/*    The index starts with the table of IRXs:                         */
+/*      [4 bytes]  number of IRXs                                      */
+/*      [32 bytes] SHA-256 of the IRX    \                             */
+/*      [8 bytes]  offset of the IRX      } for each IRX               */
+/*      [4 bytes]  size of the IRX       /                             */
+/*    followed by the table of images:                                 */
+/*      [4 bytes]  number of images                                    */
+/*      [4 bytes]  length of the name    \                             */
+/*      [...]      name of the image      |                            */
+/*      [32 bytes] SHA-256 of the image   |                            */
+/*      [4 bytes]  size of the image      |                            */
+/*      [4 bytes]  compression            } for each image             */
+/*      [8 bytes]  offset of the head     |                            */
+/*      [4 bytes]  size of the head       |                            */
+/*      [4 bytes]  number of IRXs         |                            */
+/*      [4 bytes]  IRX number, per IRX   /                             */
+/*    Integers are little endian. Unpacking an image only reads the    */
+/*    trailer, the index and the data of that image.                   */
+/*    A compressed image is stored uncompressed, and compressed again  */
+/*    when unpacked, if that gives back the very same file. Otherwise  */
+/*    the file is stored verbatim as the head of the image, with no    */
+/*    IRXs, and PACK_VERBATIM as compression; the SHA-256 and size     */
+/*    are then the ones of the file.                                   */
+/*---------------------------------------------------------------------*/
+#define PACK_MAGIC "PS2PACK1"
+#define PACK_TRAILER_SIZE 20
+#define PACK_VERBATIM -1
+
+typedef struct
+{
+  unsigned char hash[SHA256_SIZE];
+  long long offset;
+  int size;
+} blob_t;
+
+typedef struct
+{
+  blob_t *blob;
+  int nb_blobs;
+  int allocated;
+  int *table;                   // open addressing, -1 when free
+  int table_size;
+} blob_set_t;
+
+
+/*---------------------------------------------------------------------*/
+/*    blob_find ...                                                    */
+/*    -------------------------------------------------------------    */
+/*    Return the slot of the table where a hash is, or should be.      */
+/*---------------------------------------------------------------------*/
+static int blob_find( blob_set_t * s, const unsigned char *hash )
+{
+  unsigned h = hash[0] | ( hash[1] << 8 ) | ( hash[2] << 16 ) |
+    ( ( unsigned ) hash[3] << 24 );
+  int i = h & ( s->table_size - 1 );
+  while ( s->table[i] != -1 &&
+          memcmp( s->blob[s->table[i]].hash, hash, SHA256_SIZE ) != 0 )
+    i = ( i + 1 ) & ( s->table_size - 1 );
+  return i;
+}
+
+static void blob_set_grow( blob_set_t * s )
+{
+  int i;
+  s->table_size = s->table_size ? s->table_size * 2 : 1024;
+  if ( ( s->table = realloc( s->table, s->table_size * sizeof( int ) ) )
+       == NULL )
+    fatal_with_errno( "Cannot allocate memory" );
+  memset( s->table, 0xff, s->table_size * sizeof( int ) );
+  for ( i = 0; i < s->nb_blobs; i++ )
+    s->table[blob_find( s, s->blob[i].hash )] = i;
+}
+
+
+/*---------------------------------------------------------------------*/
+/*    blob_store ...                                                   */
+/*    -------------------------------------------------------------    */
+/*    Write an IRX to the pack unless it already holds it, and         */
+/*    return its number.                                               */
+/*---------------------------------------------------------------------*/
+static int blob_store( blob_set_t * s, ostream_t * o, long long *off,
+                       char *data, int size )
+{
+  unsigned char hash[SHA256_SIZE];
+  int slot;
+
+  sha256_digest( data, size, hash );
+  slot = blob_find( s, hash );
+  if ( s->table[slot] != -1 )
+    return s->table[slot];
+
+  if ( s->nb_blobs == s->allocated ) {
+    s->allocated = s->allocated ? s->allocated * 2 : 256;
+    if ( ( s->blob = realloc( s->blob, s->allocated * sizeof( blob_t ) ) )
+         == NULL )
+      fatal_with_errno( "Cannot allocate memory" );
+  }
+  memcpy( s->blob[s->nb_blobs].hash, hash, SHA256_SIZE );
+  s->blob[s->nb_blobs].offset = *off;
+  s->blob[s->nb_blobs].size = size;
+  s->table[slot] = s->nb_blobs++;
+  if ( s->nb_blobs * 2 > s->table_size )
+    blob_set_grow( s );
+
+  ostream_write( o, data, size );
+  *off += size;
+  return s->nb_blobs - 1;
+}
+
+
+/*---------------------------------------------------------------------*/
+/*    read_verbatim ...                                                */
+/*    -------------------------------------------------------------    */
+/*    Read a compressed image as it is stored, unless compressing it   */
+/*    again, as unpack_image does, gives back the same file. Returns   */
+/*    NULL in that case.                                               */
+/*---------------------------------------------------------------------*/
+static char *read_verbatim( char *image_name, char *img, int size,
+                            int compression, int *res_size )
+{
+  char *file, *again;
+  size_t again_size;
+  struct stat st;
+  ostream_t *o;
+  FILE *f;
+
+  if ( ( f = fopen( image_name, "r" ) ) == NULL ||
+       fstat( fileno( f ), &st ) == -1 )
+    fatal_with_errno( "Cannot open file %s", image_name );
+  if ( ( file = malloc( st.st_size + 1 ) ) == NULL )
+    fatal_with_errno( "Cannot allocate %d bytes for loading file %s",
+                      ( int ) st.st_size, image_name );
+  if ( fread( file, 1, st.st_size + 1, f ) != st.st_size )
+    fatal_with_errno( "Cannot read file %s", image_name );
+  fclose( f );
+
+  o = ostream_open_memory( image_name, &again, &again_size, compression );
+  ostream_write( o, img, size );
+  ostream_close( o );
+
+  if ( again_size == st.st_size &&
+       memcmp( again, file, again_size ) == 0 ) {
+    free( again );
+    free( file );
+    return NULL;
+  }
+  free( again );
+  *res_size = st.st_size;
+  return file;
+}
+
+
+/*---------------------------------------------------------------------*/
+/*    check_packed_name ...                                            */
+/*    -------------------------------------------------------------    */
+/*    Images are unpacked under their name, which must thus stay       */
+/*    below the current directory.                                     */
+/*---------------------------------------------------------------------*/
+static void check_packed_name( const char *pack_name, const char *name )
+{
+  const char *p = name;
+  if ( name[0] == '/' )
+    fatal( "Invalid image name %s in pack %s: absolute file name", name,
+           pack_name );
+  while ( p ) {
+    if ( strncmp( p, "..", 2 ) == 0 && ( p[2] == '/' || p[2] == '\0' ) )
+      fatal( "Invalid image name %s in pack %s: file name contains ..",
+             name, pack_name );
+    if ( ( p = strchr( p, '/' ) ) )
+      p++;
+  }
+}
+
+
+/*---------------------------------------------------------------------*/
+/*    pack_images ...                                                  */
+/*    -------------------------------------------------------------    */
+/*    Store a set of images into a new pack.                           */
+/*---------------------------------------------------------------------*/
+void pack_images( char *pack_name, char *image_args[], int num_images )
+{
+  blob_set_t s;
+  buffer_t images;
+  ostream_t *o;
+  long long off;
+  unsigned char hash[SHA256_SIZE];
+  int i, j, k;
+
+  memset( &s, 0, sizeof( s ) );
+  memset( &images, 0, sizeof( images ) );
+  blob_set_grow( &s );
+
+  for ( i = 0; i < num_images; i++ ) {
+    check_packed_name( pack_name, image_args[i] );
+    for ( j = 0; j < i; j++ )
+      if ( strcmp( image_args[i], image_args[j] ) == 0 )
+        fatal( "Image %s given twice", image_args[i] );
+  }
+
+  o = ostream_open_atomic( pack_name, COMPRESS_NONE );
+  ostream_write( o, PACK_MAGIC, 8 );
+  off = 8;
+
+  for ( i = 0; i < num_images; i++ ) {
+    char *img, *file;
+    int size, compression, nb_entries, head_size, end;
+    entry_t *entry;
+
+    read_file_compressed( image_args[i], &img, &size, &compression );
+    if ( compression != COMPRESS_NONE &&
+         ( file = read_verbatim( image_args[i], img, size, compression,
+                                 &size ) ) != NULL ) {
+      free( img );
+      buffer_put_int( &images, strlen( image_args[i] ) );
+      buffer_put( &images, image_args[i], strlen( image_args[i] ) );
+      sha256_digest( file, size, hash );
+      buffer_put( &images, hash, SHA256_SIZE );
+      buffer_put_int( &images, size );
+      buffer_put_int( &images, PACK_VERBATIM );
+      buffer_put_int64( &images, off );
+      buffer_put_int( &images, size );
+      buffer_put_int( &images, 0 );
+      ostream_write( o, file, size );
+      off += size;
+      if ( verbose )
+        printf( "Packing %s (verbatim, not compressed again identically)\n",
+                image_args[i] );
+      free( file );
+      continue;
+    }
+    fill_entry_descriptors( image_args[i], img, size, &entry, &nb_entries );
+    head_size = nb_entries > 3 ? entry[3].irx_offset : size;
+
+    // only the zero padding between the IRXs may be left out
+    end = head_size;
+    for ( j = 3; j <= nb_entries; j++ ) {
+      int next = j < nb_entries ? entry[j].irx_offset : size;
+      if ( next > size || ( j < nb_entries &&
+                            next + entry[j].irx_size > size ) )
+        fatal( "%s is not a valid Playstation 2 ROM image: "
+               "IRX %s out of image\n", image_args[i], entry[j].name );
+      for ( k = end; k < next; k++ )
+        if ( img[k] )
+          fatal( "Cannot pack %s: non-zero data between its IRXs",
+                 image_args[i] );
+      if ( j < nb_entries )
+        end = next + entry[j].irx_size;
+    }
+
+    buffer_put_int( &images, strlen( image_args[i] ) );
+    buffer_put( &images, image_args[i], strlen( image_args[i] ) );
+    sha256_digest( img, size, hash );
+    buffer_put( &images, hash, SHA256_SIZE );
+    buffer_put_int( &images, size );
+    buffer_put_int( &images, compression );
+    buffer_put_int64( &images, off );
+    buffer_put_int( &images, head_size );
+    ostream_write( o, img, head_size );
+    off += head_size;
+
+    buffer_put_int( &images, nb_entries - 3 );
+    for ( j = 3; j < nb_entries; j++ )
+      buffer_put_int( &images, blob_store( &s, o, &off, entry[j].irx_binary,
+                                           entry[j].irx_size ) );
+
+    if ( verbose )
+      printf( "Packing %s (%d IRXs)\n", image_args[i], nb_entries - 3 );
+    free( entry );
+    free( img );
+  }
+
+  // write the index, then the trailer which locates it
+  buffer_t index;
+  memset( &index, 0, sizeof( index ) );
+  buffer_put_int( &index, s.nb_blobs );
+  for ( i = 0; i < s.nb_blobs; i++ ) {
+    buffer_put( &index, s.blob[i].hash, SHA256_SIZE );
+    buffer_put_int64( &index, s.blob[i].offset );
+    buffer_put_int( &index, s.blob[i].size );
+  }
+  buffer_put_int( &index, num_images );
+  buffer_put( &index, images.data, images.size );
+
+  buffer_put_int64( &index, off );
+  buffer_put_int( &index, index.size - 8 );
+  buffer_put( &index, PACK_MAGIC, 8 );
+  ostream_write( o, index.data, index.size );
+  ostream_close( o );
+
+  if ( verbose )
+    printf( "Pack %s: %d images, %d distinct IRXs, %lld bytes\n",
+            pack_name, num_images, s.nb_blobs, off + index.size );
+}
+
+
+/*---------------------------------------------------------------------*/
+/*    pread_all ...                                                    */
+/*---------------------------------------------------------------------*/
+static void pread_all( const char *name, int fd, void *buf, int size,
+                       long long off )
+{
+  int n, done = 0;
+  while ( done < size ) {
+    n = pread( fd, ( char * ) buf + done, size - done, off + done );
+    if ( n == -1 && errno == EINTR )
+      continue;
+    if ( n == -1 )
+      fatal_with_errno( "Cannot read file %s", name );
+    if ( n == 0 )
+      fatal( "%s is truncated or corrupted", name );
+    done += n;
+  }
+}
+
+
+/*---------------------------------------------------------------------*/
+/*    unpack_image ...                                                 */
+/*    -------------------------------------------------------------    */
+/*    Rebuild one image from its record in the index of a pack.        */
+/*---------------------------------------------------------------------*/
+static void unpack_image( char *pack_name, int fd, reader_t * r,
+                          blob_t * blob, int nb_blobs, char *image_name )
+{
+  unsigned char *image_hash, hash[SHA256_SIZE];
+  int size, compression, head_size, nb_irx, i;
+  long long head_offset;
+  entry_t *entry;
+  int nb_entries;
+  ostream_t *o;
+  char *img;
+
+  image_hash = reader_get( r, SHA256_SIZE );
+  size = reader_get_int( r );
+  compression = reader_get_int( r );
+  head_offset = reader_get_int64( r );
+  head_size = reader_get_int( r );
+  nb_irx = reader_get_int( r );
+
+  if ( size < head_size || head_size < 0 ||
+       ( img = calloc( 1, size ) ) == NULL )
+    fatal( "%s is truncated or corrupted", pack_name );
+  pread_all( pack_name, fd, img, head_size, head_offset );
+
+  if ( compression == PACK_VERBATIM ) {
+    if ( head_size != size || nb_irx != 0 )
+      fatal( "%s is truncated or corrupted", pack_name );
+    sha256_digest( img, size, hash );
+    if ( memcmp( hash, image_hash, SHA256_SIZE ) != 0 )
+      fatal( "%s is corrupted: wrong contents for image %s", pack_name,
+             image_name );
+    write_file( image_name, ( unsigned char * ) img, size );
+    if ( verbose )
+      printf( "Unpacking %s (verbatim)\n", image_name );
+    free( img );
+    return;
+  }
+
+  // the IRXs are laid out as the head of the image says
+  fill_entry_descriptors( image_name, img, head_size, &entry, &nb_entries );
+  if ( nb_entries - 3 != nb_irx )
+    fatal( "%s is truncated or corrupted", pack_name );
+  for ( i = 3; i < nb_entries; i++ ) {
+    int n = reader_get_int( r );
+    if ( n < 0 || n >= nb_blobs || blob[n].size != entry[i].irx_size ||
+         entry[i].irx_offset > size - entry[i].irx_size )
+      fatal( "%s is truncated or corrupted", pack_name );
+    pread_all( pack_name, fd, img + entry[i].irx_offset, blob[n].size,
+               blob[n].offset );
+  }
+
+  sha256_digest( img, size, hash );
+  if ( memcmp( hash, image_hash, SHA256_SIZE ) != 0 )
+    fatal( "%s is corrupted: wrong contents for image %s", pack_name,
+           image_name );
+
+  o = ostream_open_atomic( image_name, compression );
+  ostream_write( o, img, size );
+  ostream_close( o );
+
+  if ( verbose )
+    printf( "Unpacking %s (%d IRXs)\n", image_name, nb_irx );
+  free( entry );
+  free( img );
+}
+
+
+/*---------------------------------------------------------------------*/
+/*    unpack_images ...                                                */
+/*    -------------------------------------------------------------    */
+/*    Rebuild images stored in a pack, all of them if none is given.   */
+/*    A single image may be saved under another name.                  */
+/*---------------------------------------------------------------------*/
+void unpack_images( char *pack_name, char *image_args[], int num_images,
+                    char *output )
+{
+  unsigned char trailer[PACK_TRAILER_SIZE];
+  reader_t r, t;
+  blob_t *blob;
+  int fd, nb_blobs, nb_images, i, j;
+  int *done;
+  long long size;
+
+  if ( ( fd = open( pack_name, O_RDONLY ) ) == -1 )
+    fatal_with_errno( "Cannot open file %s", pack_name );
+  if ( ( size = lseek( fd, 0, SEEK_END ) ) < 8 + PACK_TRAILER_SIZE )
+    fatal( "%s is not a valid pack", pack_name );
+  pread_all( pack_name, fd, trailer, PACK_TRAILER_SIZE,
+             size - PACK_TRAILER_SIZE );
+  if ( memcmp( trailer + 12, PACK_MAGIC, 8 ) != 0 )
+    fatal( "%s is not a valid pack", pack_name );
+
+  // load the index
+  t.name = pack_name;
+  t.data = trailer;
+  t.size = PACK_TRAILER_SIZE;
+  t.off = 0;
+  long long index_offset = reader_get_int64( &t );
+  r.name = pack_name;
+  r.size = reader_get_int( &t );
+  r.off = 0;
+  if ( index_offset < 8 || r.size < 0 ||
+       index_offset + r.size + PACK_TRAILER_SIZE != size ||
+       ( r.data = malloc( r.size ) ) == NULL )
+    fatal( "%s is truncated or corrupted", pack_name );
+  pread_all( pack_name, fd, r.data, r.size, index_offset );
+
+  nb_blobs = reader_get_int( &r );
+  if ( nb_blobs < 0 || nb_blobs > r.size / ( SHA256_SIZE + 12 ) ||
+       ( blob = malloc( nb_blobs * sizeof( blob_t ) + 1 ) ) == NULL )
+    fatal( "%s is truncated or corrupted", pack_name );
+  for ( i = 0; i < nb_blobs; i++ ) {
+    memcpy( blob[i].hash, reader_get( &r, SHA256_SIZE ), SHA256_SIZE );
+    blob[i].offset = reader_get_int64( &r );
+    blob[i].size = reader_get_int( &r );
+  }
+
+  if ( output && num_images != 1 )
+    fatal( "Exactly one image must be given to unpack it into %s", output );
+  if ( ( done = calloc( num_images + 1, sizeof( int ) ) ) == NULL )
+    fatal_with_errno( "Cannot allocate memory" );
+
+  nb_images = reader_get_int( &r );
+  for ( i = 0; i < nb_images; i++ ) {
+    int len = reader_get_int( &r );
+    char *name = strndup( ( char * ) reader_get( &r, len ), len );
+    int wanted = num_images == 0;
+    for ( j = 0; j < num_images; j++ )
+      if ( strcmp( name, image_args[j] ) == 0 )
+        wanted = done[j] = 1;
+
+    if ( wanted ) {
+      check_packed_name( pack_name, name );
+      unpack_image( pack_name, fd, &r, blob, nb_blobs,
+                    output ? output : name );
+    } else {
+      // skip the record of the image
+      reader_get( &r, SHA256_SIZE + 20 );
+      int nb_irx = reader_get_int( &r );
+      if ( nb_irx < 0 || nb_irx > r.size / 4 )
+        fatal( "%s is truncated or corrupted", pack_name );
+      reader_get( &r, 4 * nb_irx );
+    }
+    free( name );
+  }
+  close( fd );
+
+  for ( j = 0; j < num_images; j++ )
+    if ( !done[j] )
+      fatal( "Image %s not found in pack %s", image_args[j], pack_name );
+}
@@ -0,0 +1,258 @@
+/**
+ * ps2img - Create, inspect or extract Playstation 2 ROM image files
+ * Copyright (c) 2005 Damien Ciabrini (dciabrin), Olivier Parra (yo6)
+ *
+ *     ps2img is free software; you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as
+ *     published by the Free Software Foundation; either version 2 of
+ *     the License, or (at your option) any later version.
+ *
+ *     ps2img is distributed in the hope that it will be useful, but
+ *     WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public
+ *     License along with ps2img; if not, write to the Free Software
+ *     Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *     02111-1307 USA
+ *
+ * $Id$
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "common.h"
+#include "sha256.h"
+
+
+/*---------------------------------------------------------------------*/
+/*    Patch layout:                                                    */
+/*    -------------------------------------------------------------    */
+/*    A patch turns an old image into a new one. It holds the ROMDIR   */
+/*    and EXTINFO sections of the new image, and for every IRX of      */
+/*    the new image either its contents, or the hash of an identical   */
+/*    IRX of the old image. Integers are 32 bits little endian.        */
+/*      [8 bytes]  magic                                               */
+/*      [32 bytes] SHA-256 of the old image                            */
+/*      [32 bytes] SHA-256 of the new image                            */
+/*      [4 bytes]  size of the new image                               */
+/*      [4 bytes]  compression of the new image                        */
+/*      [4 bytes]  size of the head of the new image, that is its      */
+/*                 ROMDIR and EXTINFO sections and their padding       */
+/*      [...]      the head of the new image                           */
+/*    then for each IRX of the new image, in order:                    */
+/*      [1 byte]   size of the padding before the IRX                  */
+/*      [...]      the padding bytes                                   */
+/*      [1 byte]   PATCH_COPY or PATCH_DATA                            */
+/*      [32 bytes] for PATCH_COPY, SHA-256 of the IRX to copy          */
+/*      [...]      for PATCH_DATA, the IRX contents                    */
+/*    and finally:                                                     */
+/*      [4 bytes]  size of the data following the last IRX             */
+/*      [...]      those data                                          */
+/*---------------------------------------------------------------------*/
+#define PATCH_MAGIC "PS2PTCH1"
+#define PATCH_COPY  0
+#define PATCH_DATA  1
+
+
+/*---------------------------------------------------------------------*/
+/*    find_irx_by_hash ...                                             */
+/*---------------------------------------------------------------------*/
+static entry_t *find_irx_by_hash( entry_t * entry, int nb_entries,
+                                  unsigned char ( *hash )[SHA256_SIZE],
+                                  const unsigned char *wanted )
+{
+  int i;
+  for ( i = 3; i < nb_entries; i++ )
+    if ( memcmp( hash[i], wanted, SHA256_SIZE ) == 0 )
+      return &entry[i];
+  return NULL;
+}
+
+// The IRXs of an image must lie within it to be hashed
+static unsigned char ( *hash_irxs( char *img_name, entry_t * entry,
+                                   int nb_entries,
+                                   int img_size ) )[SHA256_SIZE]
+{
+  unsigned char ( *hash )[SHA256_SIZE];
+  int i;
+  if ( ( hash = malloc( nb_entries * SHA256_SIZE ) ) == NULL )
+    fatal_with_errno( "Cannot allocate memory" );
+  for ( i = 3; i < nb_entries; i++ ) {
+    if ( entry[i].irx_offset < 0 || entry[i].irx_size < 0 ||
+         entry[i].irx_offset > img_size ||
+         entry[i].irx_size > img_size - entry[i].irx_offset )
+      fatal( "%s is not a valid Playstation 2 ROM image: "
+             "IRX %s out of image\n", img_name, entry[i].name );
+    sha256_digest( entry[i].irx_binary, entry[i].irx_size, hash[i] );
+  }
+  return hash;
+}
+
+
+/*---------------------------------------------------------------------*/
+/*    make_patch ...                                                   */
+/*    -------------------------------------------------------------    */
+/*    Compute the patch turning old_name into new_name. The IRXs of    */
+/*    the new image that are present in the old one are referred to    */
+/*    by hash.                                                         */
+/*---------------------------------------------------------------------*/
+void make_patch( char *old_name, char *new_name, char *patch_name )
+{
+  char *old_img, *new_img;
+  int old_size, new_size, compression;
+  entry_t *old_entry, *new_entry;
+  int nb_old_entries, nb_new_entries;
+  unsigned char ( *old_hash )[SHA256_SIZE];
+  unsigned char ( *new_hash )[SHA256_SIZE];
+  unsigned char digest[SHA256_SIZE];
+  buffer_t b;
+  int i, off, copied = 0;
+
+  read_file( old_name, &old_img, &old_size );
+  read_file_compressed( new_name, &new_img, &new_size, &compression );
+  fill_entry_descriptors( old_name, old_img, old_size, &old_entry,
+                          &nb_old_entries );
+  fill_entry_descriptors( new_name, new_img, new_size, &new_entry,
+                          &nb_new_entries );
+  old_hash = hash_irxs( old_name, old_entry, nb_old_entries, old_size );
+  new_hash = hash_irxs( new_name, new_entry, nb_new_entries, new_size );
+
+  memset( &b, 0, sizeof( b ) );
+  buffer_put( &b, PATCH_MAGIC, 8 );
+  sha256_digest( old_img, old_size, digest );
+  buffer_put( &b, digest, SHA256_SIZE );
+  sha256_digest( new_img, new_size, digest );
+  buffer_put( &b, digest, SHA256_SIZE );
+  buffer_put_int( &b, new_size );
+  buffer_put_int( &b, compression );
+
+  // the head of the image holds the ROMDIR and EXTINFO sections
+  off = nb_new_entries > 3 ? new_entry[3].irx_offset : new_size;
+  buffer_put_int( &b, off );
+  buffer_put( &b, new_img, off );
+
+  for ( i = 3; i < nb_new_entries; i++ ) {
+    entry_t *e = &new_entry[i];
+    if ( e->irx_offset < off || e->irx_offset - off > 0xFF ||
+         e->irx_offset + e->irx_size > new_size )
+      fatal( "%s is not a valid Playstation 2 ROM image: "
+             "IRX %s out of image\n", new_name, e->name );
+    buffer_put_byte( &b, e->irx_offset - off );
+    buffer_put( &b, new_img + off, e->irx_offset - off );
+
+    if ( find_irx_by_hash( old_entry, nb_old_entries, old_hash,
+                           new_hash[i] ) ) {
+      buffer_put_byte( &b, PATCH_COPY );
+      buffer_put( &b, new_hash[i], SHA256_SIZE );
+      copied++;
+    } else {
+      buffer_put_byte( &b, PATCH_DATA );
+      buffer_put( &b, e->irx_binary, e->irx_size );
+      if ( verbose ) {
+        printf( "Storing " );
+        printf( name_format, e->name );
+        printf( "(%d bytes)\n", e->irx_size );
+      }
+    }
+    off = e->irx_offset + e->irx_size;
+  }
+
+  buffer_put_int( &b, new_size - off );
+  buffer_put( &b, new_img + off, new_size - off );
+
+  write_file_compressed( patch_name, b.data, b.size,
+                         image_compression( patch_name, COMPRESS_NONE ) );
+
+  if ( verbose )
+    printf( "Patch %s: %d IRXs copied from %s, %d stored, %d bytes\n",
+            patch_name, copied, old_name, nb_new_entries - 3 - copied,
+            b.size );
+}
+
+
+/*---------------------------------------------------------------------*/
+/*    apply_patch ...                                                  */
+/*    -------------------------------------------------------------    */
+/*    Rebuild the new image from the old image and a patch, and save   */
+/*    it as new_name.                                                  */
+/*---------------------------------------------------------------------*/
+void apply_patch( char *old_name, char *patch_name, char *new_name )
+{
+  char *old_img;
+  int old_size;
+  entry_t *old_entry, *new_entry;
+  int nb_old_entries, nb_new_entries;
+  unsigned char ( *old_hash )[SHA256_SIZE];
+  unsigned char digest[SHA256_SIZE];
+  unsigned char *old_digest, *new_digest;
+  reader_t p;
+  buffer_t b;
+  ostream_t *o;
+  int i, new_size, compression, head_size;
+
+  image_lock( new_name );
+  read_file( old_name, &old_img, &old_size );
+  p.name = patch_name;
+  p.off = 0;
+  read_file( patch_name, ( char ** ) &p.data, &p.size );
+
+  if ( memcmp( reader_get( &p, 8 ), PATCH_MAGIC, 8 ) != 0 )
+    fatal( "%s is not a valid ROM image patch", patch_name );
+  old_digest = reader_get( &p, SHA256_SIZE );
+  new_digest = reader_get( &p, SHA256_SIZE );
+  new_size = reader_get_int( &p );
+  compression = reader_get_int( &p );
+  head_size = reader_get_int( &p );
+
+  sha256_digest( old_img, old_size, digest );
+  if ( memcmp( digest, old_digest, SHA256_SIZE ) != 0 )
+    fatal( "Patch %s does not apply to ROM image %s", patch_name, old_name );
+
+  fill_entry_descriptors( old_name, old_img, old_size, &old_entry,
+                          &nb_old_entries );
+  old_hash = hash_irxs( old_name, old_entry, nb_old_entries, old_size );
+
+  // the sizes of the new IRXs are given by the new ROMDIR
+  memset( &b, 0, sizeof( b ) );
+  buffer_put( &b, reader_get( &p, head_size ), head_size );
+  fill_entry_descriptors( patch_name, ( char * ) b.data, b.size, &new_entry,
+                          &nb_new_entries );
+
+  for ( i = 3; i < nb_new_entries; i++ ) {
+    entry_t *e = &new_entry[i];
+    int gap = *reader_get( &p, 1 );
+    buffer_put( &b, reader_get( &p, gap ), gap );
+
+    if ( *reader_get( &p, 1 ) == PATCH_COPY ) {
+      entry_t *old = find_irx_by_hash( old_entry, nb_old_entries, old_hash,
+                                       reader_get( &p, SHA256_SIZE ) );
+      if ( old == NULL || old->irx_size != e->irx_size )
+        fatal( "Patch %s does not apply to ROM image %s: IRX %s not found",
+               patch_name, old_name, e->name );
+      buffer_put( &b, old->irx_binary, old->irx_size );
+    } else {
+      buffer_put( &b, reader_get( &p, e->irx_size ), e->irx_size );
+      if ( verbose ) {
+        printf( "Patching " );
+        printf( name_format, e->name );
+        printf( "(%d bytes)\n", e->irx_size );
+      }
+    }
+  }
+
+  i = reader_get_int( &p );
+  buffer_put( &b, reader_get( &p, i ), i );
+
+  sha256_digest( b.data, b.size, digest );
+  if ( b.size != new_size || memcmp( digest, new_digest, SHA256_SIZE ) != 0 )
+    fatal( "Patch %s is corrupted: wrong resulting image", patch_name );
+
+  o = ostream_open_atomic( new_name, compression );
+  ostream_write( o, b.data, b.size );
+  ostream_close( o );
+  image_unlock(  );
+}
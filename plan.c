@@ -0,0 +1,82 @@
+/**
+ * ps2img - Create, inspect or extract Playstation 2 ROM image files
+ * Copyright (c) 2005 Damien Ciabrini (dciabrin), Olivier Parra (yo6)
+ *
+ *     ps2img is free software; you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as
+ *     published by the Free Software Foundation; either version 2 of
+ *     the License, or (at your option) any later version.
+ *
+ *     ps2img is distributed in the hope that it will be useful, but
+ *     WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public
+ *     License along with ps2img; if not, write to the Free Software
+ *     Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *     02111-1307 USA
+ *
+ * $Id$
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "common.h"
+
+extern void init_entry_from_irx( entry_t * entry, char *irx );
+extern void init_entry_from_irx_headers( entry_t * entry, char *irx );
+extern void init_meta_entries( char *image_name, entry_t * entry,
+                               time_t * curtime );
+extern romdir_t *create_romdir_section( entry_t * entry, int nb_entries );
+extern int layout_image( entry_t * entry, int nb_entries, romdir_t * romdir );
+
+
+/*---------------------------------------------------------------------*/
+/*    plan_image                                                       */
+/*    -------------------------------------------------------------    */
+/*    Print the layout create_image would give to a ROM image: the     */
+/*    offset and size of each entry, and the size of the image. Only   */
+/*    the headers of the IRXs are read, unless they are to be          */
+/*    stripped, and nothing is written. A max_size other than 0        */
+/*    makes images bigger than it an error.                            */
+/*---------------------------------------------------------------------*/
+void plan_image( char *image_name, char *irx_args[], int num_irx,
+                 long max_size )
+{
+  int nb_entries = num_irx + 3;
+  entry_t *entry;
+  romdir_t *romdir;
+  int i, size;
+
+  if ( ( entry = malloc( sizeof( entry_t ) * nb_entries ) ) == NULL )
+    fatal_with_errno( "Cannot allocate %d bytes of memory",
+                      sizeof( entry_t ) * nb_entries );
+
+  time_t curtime = build_time(  );
+  for ( i = 0; i < num_irx; i++ )
+    // the size of a stripped IRX is only known once it is stripped
+    if ( strip_irxs )
+      init_entry_from_irx( &entry[i + 3], irx_args[i] );
+    else
+      init_entry_from_irx_headers( &entry[i + 3], irx_args[i] );
+  init_meta_entries( image_name, entry, &curtime );
+
+  romdir = create_romdir_section( entry, nb_entries );
+  size = layout_image( entry, nb_entries, romdir );
+
+  printf( "%-9s %-8s %10s\n", "NAME", "OFFSET", "SIZE" );
+  printf( "-----------------------------\n" );
+  for ( i = 0; i < nb_entries; i++ )
+    printf( "%-9s %08X %10d\n", entry[i].name, entry[i].irx_offset,
+            entry[i].irx_size );
+  printf( "Total size of ROM image %s: %d bytes\n", image_name, size );
+
+  if ( max_size && size > max_size )
+    fatal( "ROM image %s would be %ld bytes over the maximum size of "
+           "%ld bytes", image_name, size - max_size, max_size );
+  free( romdir );
+  free( entry );
+}
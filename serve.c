@@ -0,0 +1,316 @@
+/**
+ * ps2img - Create, inspect or extract Playstation 2 ROM image files
+ * Copyright (c) 2005 Damien Ciabrini (dciabrin), Olivier Parra (yo6)
+ *
+ *     ps2img is free software; you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as
+ *     published by the Free Software Foundation; either version 2 of
+ *     the License, or (at your option) any later version.
+ *
+ *     ps2img is distributed in the hope that it will be useful, but
+ *     WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public
+ *     License along with ps2img; if not, write to the Free Software
+ *     Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *     02111-1307 USA
+ *
+ * $Id$
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+
+#include "common.h"
+#include "elf.h"
+#include "serve.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <unistd.h>
+
+extern int run_command( int argc, char *argv[] );
+extern void load_entry_from_irx( entry_t * entry, char *irx, char *name );
+
+int serving;
+
+
+/*---------------------------------------------------------------------*/
+/*    Output of the request being served ...                           */
+/*---------------------------------------------------------------------*/
+static int reply_fd;
+static char *reply_out;
+static char *reply_err;
+static size_t reply_out_size;
+static size_t reply_err_size;
+static FILE *server_err;
+
+
+/*---------------------------------------------------------------------*/
+/*    send_reply ...                                                   */
+/*    -------------------------------------------------------------    */
+/*    Exit handler of a request process: send the output of the        */
+/*    command and its exit status to the client.                       */
+/*---------------------------------------------------------------------*/
+static void send_reply( int status, void *arg )
+{
+  unsigned char st[4];
+  fflush( stdout );
+  fflush( stderr );
+  st[0] = status >> 24;
+  st[1] = status >> 16;
+  st[2] = status >> 8;
+  st[3] = status;
+  if ( !frame_write( reply_fd, FRAME_STDOUT, reply_out, reply_out_size ) ||
+       !frame_write( reply_fd, FRAME_STDERR, reply_err, reply_err_size ) ||
+       !frame_write( reply_fd, FRAME_STATUS, st, sizeof( st ) ) )
+    fprintf( server_err, "%s: Cannot send a reply: client went away\n",
+             program_name );
+  close( reply_fd );
+}
+
+
+/*---------------------------------------------------------------------*/
+/*    send_preload_hints ...                                           */
+/*    -------------------------------------------------------------    */
+/*    Tell the server which arguments of a request name ELF files,     */
+/*    so that it loads them into its cache for the following           */
+/*    requests: the request itself, and the ones already running,      */
+/*    still read them from disk. Each absolute path is sent as a datagram; hints are    */
+/*    dropped rather than waited for when the server is busy.          */
+/*---------------------------------------------------------------------*/
+static void send_preload_hints( int hints, char *cwd, int argc, char *argv[] )
+{
+  char magic[4];
+  char path[PIPE_BUF];
+  struct stat st;
+  int i, fd;
+
+  for ( i = 1; i < argc; i++ ) {
+    if ( argv[i][0] == '-' || stat( argv[i], &st ) == -1 ||
+         !S_ISREG( st.st_mode ) )
+      continue;
+    if ( ( fd = open( argv[i], O_RDONLY ) ) == -1 )
+      continue;
+    int n = read( fd, magic, sizeof( magic ) );
+    close( fd );
+    if ( n != sizeof( magic ) || memcmp( magic, ELF_MAGIC, 4 ) != 0 )
+      continue;
+
+    if ( argv[i][0] == '/' )
+      n = snprintf( path, sizeof( path ), "%s", argv[i] );
+    else
+      n = snprintf( path, sizeof( path ), "%s/%s", cwd, argv[i] );
+    if ( n < sizeof( path ) )
+      send( hints, path, n + 1, MSG_DONTWAIT );
+  }
+}
+
+
+/*---------------------------------------------------------------------*/
+/*    serve_request ...                                                */
+/*    -------------------------------------------------------------    */
+/*    Read a request and run its command, in the process forked for    */
+/*    its connection, so that a slow client only delays itself. The    */
+/*    output is collected in memory and sent back on exit, which       */
+/*    also covers commands stopped by a fatal error.                   */
+/*---------------------------------------------------------------------*/
+static void serve_request( int fd, int hints )
+{
+  int type, size, argc, i;
+  char *req, *cwd, **argv;
+
+  if ( !frame_read( fd, &type, &req, &size ) )
+    exit( 1 );
+  if ( type != FRAME_REQUEST || size == 0 || req[size - 1] != '\0' )
+    exit( 1 );
+
+  // split the request into the working directory and the arguments
+  for ( argc = 0, i = 0; i < size; i++ )
+    if ( req[i] == '\0' )
+      argc++;
+  if ( ( argv = malloc( ( argc + 1 ) * sizeof( char * ) ) ) == NULL )
+    exit( 1 );
+  cwd = req;
+  argv[0] = program_name;
+  for ( argc = 1, i = strlen( cwd ) + 1; i < size;
+        i += strlen( req + i ) + 1 )
+    argv[argc++] = req + i;
+  argv[argc] = NULL;
+
+  reply_fd = fd;
+  server_err = stderr;
+  if ( ( stdout = open_memstream( &reply_out, &reply_out_size ) ) == NULL ||
+       ( stderr = open_memstream( &reply_err, &reply_err_size ) ) == NULL )
+    exit( 1 );
+  on_exit( send_reply, NULL );
+
+  if ( chdir( cwd ) == -1 )
+    fatal_with_errno( "Cannot change to directory %s", cwd );
+
+  send_preload_hints( hints, cwd, argc, argv );
+  close( hints );
+
+  exit( run_command( argc, argv ) );
+}
+
+
+/*---------------------------------------------------------------------*/
+/*    preload_irx ...                                                  */
+/*    -------------------------------------------------------------    */
+/*    Load into the server's cache an IRX named by a request, so       */
+/*    that it is shared by the requests accepted from then on. The     */
+/*    cache evicts the least recently used IRXs beyond its limit.      */
+/*---------------------------------------------------------------------*/
+static void preload_irx( char *path )
+{
+  jmp_buf recovery;
+  struct stat st;
+  entry_t entry;
+
+  if ( stat( path, &st ) == -1 || !S_ISREG( st.st_mode ) )
+    return;
+
+  // invalid IRXs were already reported to the client by the request
+  fatal_recovery = &recovery;
+  if ( !setjmp( recovery ) )
+    load_entry_from_irx( &entry, path, basename( path ) );
+  fatal_recovery = NULL;
+
+  // the server builds no image: an outdated copy is no longer used
+  irx_cache_collect(  );
+}
+
+
+/*---------------------------------------------------------------------*/
+/*    serve_requests ...                                               */
+/*    -------------------------------------------------------------    */
+/*    Listen on a Unix domain socket and serve requests forever.       */
+/*    Each connection is handed to a child process right away, so      */
+/*    that requests run concurrently and inherit the IRXs cached by    */
+/*    the server. The children send back the IRXs they use, which      */
+/*    the server loads between two connections: an IRX is only warm    */
+/*    for the requests accepted after the one that first used it.      */
+/*    Only the user running the server, or root, may connect.          */
+/*---------------------------------------------------------------------*/
+// struct ucred is only declared with _GNU_SOURCE, under which
+// <string.h> declares a basename of its own
+struct peer_cred
+{
+  pid_t pid;
+  uid_t uid;
+  gid_t gid;
+};
+
+static int peer_allowed( int c )
+{
+  struct peer_cred cred;
+  socklen_t len = sizeof( cred );
+
+  if ( getsockopt( c, SOL_SOCKET, SO_PEERCRED, &cred, &len ) == -1 )
+    return 0;
+  return cred.uid == geteuid(  ) || cred.uid == 0;
+}
+
+
+void serve_requests( char *socket_path )
+{
+  struct sockaddr_un addr;
+  struct pollfd pfd[2];
+  struct stat st;
+  int s, hints[2];
+
+  // requests are not allowed to start servers of their own
+  if ( serving )
+    fatal( "Already serving requests" );
+  serving = 1;
+
+  memset( &addr, 0, sizeof( addr ) );
+  addr.sun_family = AF_UNIX;
+  if ( strlen( socket_path ) >= sizeof( addr.sun_path ) )
+    fatal( "Socket name %s is too long", socket_path );
+  strcpy( addr.sun_path, socket_path );
+
+  // remove a stale socket left by a previous server
+  if ( stat( socket_path, &st ) == 0 && S_ISSOCK( st.st_mode ) )
+    unlink( socket_path );
+
+  if ( ( s = socket( AF_UNIX, SOCK_STREAM, 0 ) ) == -1 )
+    fatal_with_errno( "Cannot create socket" );
+  if ( bind( s, ( struct sockaddr * ) &addr, sizeof( addr ) ) == -1 )
+    fatal_with_errno( "Cannot bind socket %s", socket_path );
+  if ( listen( s, 64 ) == -1 )
+    fatal_with_errno( "Cannot listen on socket %s", socket_path );
+  if ( socketpair( AF_UNIX, SOCK_DGRAM, 0, hints ) == -1 )
+    fatal_with_errno( "Cannot create socket" );
+
+  // request processes are reaped automatically
+  signal( SIGCHLD, SIG_IGN );
+  signal( SIGPIPE, SIG_IGN );
+  irx_cache_enable(  );
+
+  if ( verbose )
+    printf( "Serving requests on %s\n", socket_path );
+  fflush( stdout );
+
+  pfd[0].fd = s;
+  pfd[0].events = POLLIN;
+  pfd[1].fd = hints[0];
+  pfd[1].events = POLLIN;
+  for ( ;; ) {
+    char path[PIPE_BUF];
+    int c;
+
+    if ( poll( pfd, 2, -1 ) == -1 ) {
+      if ( errno == EINTR )
+        continue;
+      fatal_with_errno( "Cannot wait for connections on %s", socket_path );
+    }
+
+    if ( pfd[0].revents & POLLIN ) {
+      if ( ( c = accept( s, NULL, NULL ) ) == -1 ) {
+        if ( errno == EINTR || errno == ECONNABORTED )
+          continue;
+        fatal_with_errno( "Cannot accept connection on %s", socket_path );
+      }
+      if ( !peer_allowed( c ) ) {
+        warning( "Refusing a connection from another user on %s",
+                 socket_path );
+        close( c );
+        continue;
+      }
+
+      fflush( NULL );
+      switch ( fork(  ) ) {
+      case -1:
+        warning( "Cannot fork to serve a request: %s", strerror( errno ) );
+        break;
+      case 0:
+        close( s );
+        close( hints[0] );
+        serve_request( c, hints[1] );
+        break;
+      }
+      close( c );
+    }
+
+    // accept the pending connections before loading anything
+    if ( ( pfd[1].revents & POLLIN ) && !( pfd[0].revents & POLLIN ) ) {
+      ssize_t n = recv( hints[0], path, sizeof( path ) - 1, MSG_DONTWAIT );
+      if ( n > 0 ) {
+        path[n] = '\0';
+        preload_irx( path );
+      }
+    }
+  }
+}
@@ -0,0 +1,50 @@
+/**
+ * ps2img - Create, inspect or extract Playstation 2 ROM image files
+ * Copyright (c) 2005 Damien Ciabrini (dciabrin), Olivier Parra (yo6)
+ *
+ *     ps2img is free software; you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as
+ *     published by the Free Software Foundation; either version 2 of
+ *     the License, or (at your option) any later version.
+ *
+ *     ps2img is distributed in the hope that it will be useful, but
+ *     WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public
+ *     License along with ps2img; if not, write to the Free Software
+ *     Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *     02111-1307 USA
+ *
+ * $Id$
+ */
+
+#ifndef __SERVE_H__
+#define __SERVE_H__
+
+/*---------------------------------------------------------------------*/
+/*    Server protocol:                                                 */
+/*    -------------------------------------------------------------    */
+/*    Client and server exchange frames over a Unix domain socket.     */
+/*    A frame is a 1 byte type, a 4 bytes big endian payload size,     */
+/*    and the payload itself.                                          */
+/*      * the client sends a single REQUEST frame, holding the         */
+/*        client's working directory followed by the command line      */
+/*        arguments, each of them terminated by a NUL byte.            */
+/*      * the server answers with the STDOUT and STDERR frames         */
+/*        holding the output of the command, and finally a STATUS      */
+/*        frame holding its 4 bytes big endian exit status.            */
+/*---------------------------------------------------------------------*/
+#define FRAME_REQUEST 'R'
+#define FRAME_STDOUT  'O'
+#define FRAME_STDERR  'E'
+#define FRAME_STATUS  'X'
+
+#define FRAME_MAX_SIZE 0x4000000
+
+
+int frame_write (int fd, int type, const void *data, int size);
+int frame_read (int fd, int *type, char **data, int *size);
+
+#endif
@@ -0,0 +1,193 @@
+/**
+ * ps2img - Create, inspect or extract Playstation 2 ROM image files
+ * Copyright (c) 2005 Damien Ciabrini (dciabrin), Olivier Parra (yo6)
+ *
+ *     ps2img is free software; you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as
+ *     published by the Free Software Foundation; either version 2 of
+ *     the License, or (at your option) any later version.
+ *
+ *     ps2img is distributed in the hope that it will be useful, but
+ *     WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public
+ *     License along with ps2img; if not, write to the Free Software
+ *     Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *     02111-1307 USA
+ *
+ * $Id$
+ */
+
+/*---------------------------------------------------------------------*/
+/*    A straightforward implementation of SHA-256 (FIPS 180-2), used   */
+/*    to identify IRX payloads by their contents.                      */
+/*---------------------------------------------------------------------*/
+
+#include <string.h>
+#include "sha256.h"
+
+static const unsigned int k[64] = {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+  0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+  0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+  0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+  0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+  0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+  0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+  0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+  0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+  0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+  0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+  0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+  0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+  0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+  0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+  0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define ROR( x, n ) ( ( ( x ) >> ( n ) ) | ( ( x ) << ( 32 - ( n ) ) ) )
+
+
+/*---------------------------------------------------------------------*/
+/*    sha256_transform ...                                             */
+/*    -------------------------------------------------------------    */
+/*    Process one 64 bytes block of input.                             */
+/*---------------------------------------------------------------------*/
+static void sha256_transform( sha256_t * ctx, const unsigned char *data )
+{
+  unsigned int w[64];
+  unsigned int a, b, c, d, e, f, g, h, t1, t2;
+  int i;
+
+  for ( i = 0; i < 16; i++ )
+    w[i] = ( data[i * 4] << 24 ) | ( data[i * 4 + 1] << 16 ) |
+      ( data[i * 4 + 2] << 8 ) | data[i * 4 + 3];
+  for ( i = 16; i < 64; i++ ) {
+    unsigned int s0 = ROR( w[i - 15], 7 ) ^ ROR( w[i - 15], 18 ) ^
+      ( w[i - 15] >> 3 );
+    unsigned int s1 = ROR( w[i - 2], 17 ) ^ ROR( w[i - 2], 19 ) ^
+      ( w[i - 2] >> 10 );
+    w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+  }
+
+  a = ctx->state[0];
+  b = ctx->state[1];
+  c = ctx->state[2];
+  d = ctx->state[3];
+  e = ctx->state[4];
+  f = ctx->state[5];
+  g = ctx->state[6];
+  h = ctx->state[7];
+
+  for ( i = 0; i < 64; i++ ) {
+    t1 = h + ( ROR( e, 6 ) ^ ROR( e, 11 ) ^ ROR( e, 25 ) ) +
+      ( ( e & f ) ^ ( ~e & g ) ) + k[i] + w[i];
+    t2 = ( ROR( a, 2 ) ^ ROR( a, 13 ) ^ ROR( a, 22 ) ) +
+      ( ( a & b ) ^ ( a & c ) ^ ( b & c ) );
+    h = g;
+    g = f;
+    f = e;
+    e = d + t1;
+    d = c;
+    c = b;
+    b = a;
+    a = t1 + t2;
+  }
+
+  ctx->state[0] += a;
+  ctx->state[1] += b;
+  ctx->state[2] += c;
+  ctx->state[3] += d;
+  ctx->state[4] += e;
+  ctx->state[5] += f;
+  ctx->state[6] += g;
+  ctx->state[7] += h;
+}
+
+
+void sha256_init( sha256_t * ctx )
+{
+  ctx->state[0] = 0x6a09e667;
+  ctx->state[1] = 0xbb67ae85;
+  ctx->state[2] = 0x3c6ef372;
+  ctx->state[3] = 0xa54ff53a;
+  ctx->state[4] = 0x510e527f;
+  ctx->state[5] = 0x9b05688c;
+  ctx->state[6] = 0x1f83d9ab;
+  ctx->state[7] = 0x5be0cd19;
+  ctx->length = 0;
+  ctx->used = 0;
+}
+
+void sha256_update( sha256_t * ctx, const void *data, int size )
+{
+  const unsigned char *p = data;
+  ctx->length += size;
+
+  // complete a pending block first
+  if ( ctx->used ) {
+    int n = 64 - ctx->used;
+    if ( n > size )
+      n = size;
+    memcpy( ctx->block + ctx->used, p, n );
+    ctx->used += n;
+    p += n;
+    size -= n;
+    if ( ctx->used < 64 )
+      return;
+    sha256_transform( ctx, ctx->block );
+    ctx->used = 0;
+  }
+
+  for ( ; size >= 64; p += 64, size -= 64 )
+    sha256_transform( ctx, p );
+
+  memcpy( ctx->block, p, size );
+  ctx->used = size;
+}
+
+void sha256_final( sha256_t * ctx, unsigned char digest[SHA256_SIZE] )
+{
+  unsigned long long bits = ctx->length * 8;
+  int i;
+
+  ctx->block[ctx->used++] = 0x80;
+  if ( ctx->used > 56 ) {
+    memset( ctx->block + ctx->used, 0, 64 - ctx->used );
+    sha256_transform( ctx, ctx->block );
+    ctx->used = 0;
+  }
+  memset( ctx->block + ctx->used, 0, 56 - ctx->used );
+  for ( i = 0; i < 8; i++ )
+    ctx->block[56 + i] = bits >> ( 56 - i * 8 );
+  sha256_transform( ctx, ctx->block );
+
+  for ( i = 0; i < 8; i++ ) {
+    digest[i * 4] = ctx->state[i] >> 24;
+    digest[i * 4 + 1] = ctx->state[i] >> 16;
+    digest[i * 4 + 2] = ctx->state[i] >> 8;
+    digest[i * 4 + 3] = ctx->state[i];
+  }
+}
+
+void sha256_digest( const void *data, int size,
+                    unsigned char digest[SHA256_SIZE] )
+{
+  sha256_t ctx;
+  sha256_init( &ctx );
+  sha256_update( &ctx, data, size );
+  sha256_final( &ctx, digest );
+}
+
+void sha256_to_hex( const unsigned char digest[SHA256_SIZE], char *hex )
+{
+  static const char digits[] = "0123456789abcdef";
+  int i;
+  for ( i = 0; i < SHA256_SIZE; i++ ) {
+    hex[i * 2] = digits[digest[i] >> 4];
+    hex[i * 2 + 1] = digits[digest[i] & 0xF];
+  }
+  hex[SHA256_HEX_SIZE - 1] = '\0';
+}
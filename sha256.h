@@ -0,0 +1,48 @@
+/**
+ * ps2img - Create, inspect or extract Playstation 2 ROM image files
+ * Copyright (c) 2005 Damien Ciabrini (dciabrin), Olivier Parra (yo6)
+ *
+ *     ps2img is free software; you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as
+ *     published by the Free Software Foundation; either version 2 of
+ *     the License, or (at your option) any later version.
+ *
+ *     ps2img is distributed in the hope that it will be useful, but
+ *     WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public
+ *     License along with ps2img; if not, write to the Free Software
+ *     Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *     02111-1307 USA
+ *
+ * $Id$
+ */
+
+#ifndef __SHA256_H__
+#define __SHA256_H__
+
+#define SHA256_SIZE     32
+#define SHA256_HEX_SIZE ( 2 * SHA256_SIZE + 1 )
+
+/*---------------------------------------------------------------------*/
+/*    The SHA-256 context ...                                          */
+/*---------------------------------------------------------------------*/
+typedef struct
+{
+  unsigned int state[8];
+  unsigned long long length;
+  unsigned char block[64];
+  int used;
+} sha256_t;
+
+
+void sha256_init (sha256_t * ctx);
+void sha256_update (sha256_t * ctx, const void *data, int size);
+void sha256_final (sha256_t * ctx, unsigned char digest[SHA256_SIZE]);
+void sha256_digest (const void *data, int size,
+                    unsigned char digest[SHA256_SIZE]);
+void sha256_to_hex (const unsigned char digest[SHA256_SIZE], char *hex);
+
+#endif
@@ -0,0 +1,131 @@
+/**
+ * ps2img - Create, inspect or extract Playstation 2 ROM image files
+ * Copyright (c) 2005 Damien Ciabrini (dciabrin), Olivier Parra (yo6)
+ *
+ *     ps2img is free software; you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as
+ *     published by the Free Software Foundation; either version 2 of
+ *     the License, or (at your option) any later version.
+ *
+ *     ps2img is distributed in the hope that it will be useful, but
+ *     WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public
+ *     License along with ps2img; if not, write to the Free Software
+ *     Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *     02111-1307 USA
+ *
+ * $Id$
+ */
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include "common.h"
+#include "sha256.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+/*---------------------------------------------------------------------*/
+/*    Extraction store ...                                             */
+/*    -------------------------------------------------------------    */
+/*    With --store=DIR, every distinct IRX extracted is written once   */
+/*    into DIR, named after the hash of its contents like the images   */
+/*    of the cache (DIR/xx/xxxx...), and the extracted entries are     */
+/*    hardlinks to these objects. Objects are read-only, since all     */
+/*    the entries with the same contents share them, and are checked   */
+/*    against their hash before being linked again.                    */
+/*---------------------------------------------------------------------*/
+
+
+/*---------------------------------------------------------------------*/
+/*    object_intact ...                                                */
+/*    -------------------------------------------------------------    */
+/*    Tell whether a stored object still holds the size bytes hashing  */
+/*    to digest. Its read-only mode does not stop root, a chmod, or a  */
+/*    program appending to an extracted entry, which is the object.    */
+/*---------------------------------------------------------------------*/
+static int object_intact( char *object, struct stat *st, int size,
+                          const unsigned char digest[SHA256_SIZE] )
+{
+  unsigned char object_digest[SHA256_SIZE];
+  char *data;
+  int object_size;
+
+  if ( !S_ISREG( st->st_mode ) || st->st_size != size )
+    return 0;
+  read_file( object, &data, &object_size );
+  sha256_digest( data, object_size, object_digest );
+  free( data );
+  return object_size == size &&
+    memcmp( object_digest, digest, SHA256_SIZE ) == 0;
+}
+
+
+/*---------------------------------------------------------------------*/
+/*    store_entry ...                                                  */
+/*    -------------------------------------------------------------    */
+/*    Extract an IRX as file name through the store. The IRX is only   */
+/*    written if the store does not hold it yet, or holds a modified   */
+/*    copy: the object is then written anew, and the names still       */
+/*    linked to the modified one are left alone. When name cannot be   */
+/*    linked to the object (other filesystem, too many links), it is   */
+/*    written as a plain file.                                         */
+/*    The SHA-256 digest of the IRX may be given when it is already    */
+/*    known, or NULL.                                                  */
+/*---------------------------------------------------------------------*/
+void store_entry( const char *name, const void *data, int size,
+                  const unsigned char *digest )
+{
+  unsigned char data_digest[SHA256_SIZE];
+  struct stat object_st, st;
+  char *subdir, *object, *tmp;
+
+  if ( digest == NULL ) {
+    sha256_digest( data, size, data_digest );
+    digest = data_digest;
+  }
+  object = object_name( store_dir, digest, &subdir );
+
+  if ( stat( object, &object_st ) == -1 ||
+       !object_intact( object, &object_st, size, digest ) ) {
+    if ( ( mkdir( store_dir, 0777 ) == -1 && errno != EEXIST ) ||
+         ( mkdir( subdir, 0777 ) == -1 && errno != EEXIST ) )
+      fatal_with_errno( "Cannot create directory %s", subdir );
+    // write_file replaces the object, it does not write through it
+    write_file( object, ( unsigned char * ) data, size );
+    if ( chmod( object, 0444 ) == -1 || stat( object, &object_st ) == -1 )
+      fatal_with_errno( "Cannot store %s into %s", name, store_dir );
+  } else if ( stat( name, &st ) == 0 && st.st_dev == object_st.st_dev &&
+              st.st_ino == object_st.st_ino ) {
+    // extracted before, nothing to write
+    free( subdir );
+    free( object );
+    return;
+  }
+
+  if ( ( tmp = malloc( strlen( name ) + 32 ) ) == NULL )
+    fatal_with_errno( "Cannot allocate memory" );
+  sprintf( tmp, "%s.%d.tmp", name, ( int ) getpid(  ) );
+
+  // replace the entry at once, so that it is never seen half-written
+  if ( link( object, tmp ) == 0 ) {
+    if ( rename( tmp, name ) == -1 ) {
+      unlink( tmp );
+      fatal_with_errno( "Cannot create file %s", name );
+    }
+  } else
+    write_file( name, ( unsigned char * ) data, size );
+
+  free( tmp );
+  free( subdir );
+  free( object );
+}
@@ -0,0 +1,274 @@
+/**
+ * ps2img - Create, inspect or extract Playstation 2 ROM image files
+ * Copyright (c) 2005 Damien Ciabrini (dciabrin), Olivier Parra (yo6)
+ *
+ *     ps2img is free software; you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as
+ *     published by the Free Software Foundation; either version 2 of
+ *     the License, or (at your option) any later version.
+ *
+ *     ps2img is distributed in the hope that it will be useful, but
+ *     WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public
+ *     License along with ps2img; if not, write to the Free Software
+ *     Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *     02111-1307 USA
+ *
+ * $Id$
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "common.h"
+#include "elf.h"
+
+
+/*---------------------------------------------------------------------*/
+/*    Stripping IRXs ...                                               */
+/*    -------------------------------------------------------------    */
+/*    The IOP loader only reads the ELF header, the program headers,   */
+/*    the loaded segments, the .iopmod section and the relocations     */
+/*    of the loaded sections. Everything else (.comment, .mdebug...)   */
+/*    can be dropped. Relocations are not rewritten, so the symbol     */
+/*    table they use, in practice that of every IRX, is kept along     */
+/*    with its names: mostly debugging sections go.                    */
+/*    The file is rebuilt from chunks of the original one: the         */
+/*    headers, each loaded segment and each kept section outside the   */
+/*    segments. A chunk is moved as a whole, and keeps its offset      */
+/*    modulo its alignment, so that the segments stay valid. The       */
+/*    section names and the section header table are rebuilt at the   */
+/*    end of the file.                                                 */
+/*---------------------------------------------------------------------*/
+typedef struct
+{
+  unsigned old;
+  unsigned size;
+  unsigned align;
+  unsigned new;
+} chunk_t;
+
+static int compare_chunks( const void *a, const void *b )
+{
+  const chunk_t *x = a, *y = b;
+  return x->old < y->old ? -1 : x->old > y->old;
+}
+
+static void add_chunk( chunk_t * chunk, int *nb_chunks, unsigned old,
+                       unsigned size, unsigned align )
+{
+  chunk[*nb_chunks].old = old;
+  chunk[*nb_chunks].size = size;
+  chunk[*nb_chunks].align = align ? align : 1;
+  ( *nb_chunks )++;
+}
+
+// New offset of some data of the original file, 0 if it was dropped
+static unsigned map_offset( chunk_t * chunk, int nb_chunks, unsigned old )
+{
+  int i;
+  for ( i = 0; i < nb_chunks; i++ )
+    if ( old >= chunk[i].old && old <= chunk[i].old + chunk[i].size )
+      return chunk[i].new + old - chunk[i].old;
+  return 0;
+}
+
+
+/*---------------------------------------------------------------------*/
+/*    strip_irx ...                                                    */
+/*    -------------------------------------------------------------    */
+/*    Return a copy of an IRX without the sections the IOP does not    */
+/*    need, or the IRX itself when nothing can be dropped.             */
+/*---------------------------------------------------------------------*/
+char *strip_irx( char *irx, char *elf, int *size )
+{
+  Elf32_Ehdr *eh = ( Elf32_Ehdr * ) elf;
+  Elf32_Shdr *sh, *new_sh;
+  Elf32_Phdr *ph;
+  char *strtab, *out;
+  chunk_t *chunk;
+  int *keep, *new_index;
+  int i, j, nb_chunks = 0, nb_kept = 0, strtab_size, names_size = 1;
+  unsigned off, shoff, total;
+
+  if ( *size < sizeof( Elf32_Ehdr ) ||
+       memcmp( eh->e_ident, ELF_MAGIC, 4 ) != 0 ||
+       eh->e_shentsize != sizeof( Elf32_Shdr ) ||
+       eh->e_shstrndx >= eh->e_shnum ||
+       eh->e_shoff > *size ||
+       eh->e_shnum * sizeof( Elf32_Shdr ) > *size - eh->e_shoff ||
+       ( eh->e_phnum && ( eh->e_phentsize != sizeof( Elf32_Phdr ) ||
+                          eh->e_phoff > *size ||
+                          eh->e_phnum * sizeof( Elf32_Phdr ) >
+                          *size - eh->e_phoff ) ) )
+    fatal( "Invalid IRX %s: not an ELF file.", irx );
+
+  sh = ( Elf32_Shdr * ) ( elf + eh->e_shoff );
+  ph = ( Elf32_Phdr * ) ( elf + eh->e_phoff );
+  for ( i = 0; i < eh->e_shnum; i++ )
+    if ( sh[i].sh_type != ELF_SHT_NOBITS &&
+         ( sh[i].sh_offset > *size ||
+           sh[i].sh_size > *size - sh[i].sh_offset ) )
+      fatal( "Invalid IRX %s: section out of file.", irx );
+  for ( i = 0; i < eh->e_phnum; i++ )
+    if ( ph[i].p_offset > *size || ph[i].p_filesz > *size - ph[i].p_offset )
+      fatal( "Invalid IRX %s: segment out of file.", irx );
+  strtab = elf + sh[eh->e_shstrndx].sh_offset;
+  strtab_size = sh[eh->e_shstrndx].sh_size;
+
+  if ( ( keep = calloc( eh->e_shnum, sizeof( int ) ) ) == NULL ||
+       ( new_index = calloc( eh->e_shnum, sizeof( int ) ) ) == NULL ||
+       ( chunk = malloc( ( eh->e_shnum + eh->e_phnum + 2 ) *
+                         sizeof( chunk_t ) ) ) == NULL )
+    fatal_with_errno( "Cannot allocate memory" );
+
+  // keep the loaded sections and the module information
+  keep[0] = keep[eh->e_shstrndx] = 1;
+  for ( i = 1; i < eh->e_shnum; i++ )
+    if ( ( sh[i].sh_flags & ELF_SHF_ALLOC ) ||
+         sh[i].sh_type == ELF_SHT_IOPMOD )
+      keep[i] = 1;
+  if ( ( i = iopmod_section_index( sh, eh->e_shnum, strtab,
+                                   strtab_size ) ) != -1 )
+    keep[i] = 1;
+
+  // keep their relocations, and the symbols those relocations use
+  for ( i = 1; i < eh->e_shnum; i++ ) {
+    if ( ( sh[i].sh_type != ELF_SHT_REL && sh[i].sh_type != ELF_SHT_RELA ) ||
+         sh[i].sh_info >= eh->e_shnum || !keep[sh[i].sh_info] )
+      continue;
+    keep[i] = 1;
+    j = sh[i].sh_link;
+    if ( j && j < eh->e_shnum ) {
+      keep[j] = 1;
+      if ( sh[j].sh_link && sh[j].sh_link < eh->e_shnum )
+        keep[sh[j].sh_link] = 1;
+    }
+  }
+
+  for ( i = 0; i < eh->e_shnum; i++ ) {
+    if ( keep[i] ) {
+      new_index[i] = nb_kept++;
+      if ( sh[i].sh_name < strtab_size )
+        names_size += strnlen( strtab + sh[i].sh_name,
+                               strtab_size - sh[i].sh_name ) + 1;
+    }
+  }
+
+  // gather the chunks of the original file to copy
+  add_chunk( chunk, &nb_chunks, 0, sizeof( Elf32_Ehdr ), 4 );
+  if ( eh->e_phnum )
+    add_chunk( chunk, &nb_chunks, eh->e_phoff,
+               eh->e_phnum * sizeof( Elf32_Phdr ), 4 );
+  for ( i = 0; i < eh->e_phnum; i++ )
+    if ( ph[i].p_filesz )
+      add_chunk( chunk, &nb_chunks, ph[i].p_offset, ph[i].p_filesz,
+                 ph[i].p_align );
+  for ( i = 1; i < eh->e_shnum; i++ )
+    if ( keep[i] && i != eh->e_shstrndx &&
+         sh[i].sh_type != ELF_SHT_NOBITS && sh[i].sh_size )
+      add_chunk( chunk, &nb_chunks, sh[i].sh_offset, sh[i].sh_size,
+                 sh[i].sh_addralign );
+
+  // merge the overlapping chunks, and lay them out
+  qsort( chunk, nb_chunks, sizeof( chunk_t ), compare_chunks );
+  for ( i = 1, j = 0; i < nb_chunks; i++ ) {
+    if ( chunk[i].old <= chunk[j].old + chunk[j].size ) {
+      if ( chunk[i].old + chunk[i].size > chunk[j].old + chunk[j].size )
+        chunk[j].size = chunk[i].old + chunk[i].size - chunk[j].old;
+      if ( chunk[j].align < chunk[i].align )
+        chunk[j].align = chunk[i].align;
+    } else
+      chunk[++j] = chunk[i];
+  }
+  nb_chunks = j + 1;
+
+  off = 0;
+  for ( i = 0; i < nb_chunks; i++ ) {
+    unsigned a = chunk[i].align;
+    off += ( chunk[i].old % a + a - off % a ) % a;
+    chunk[i].new = off;
+    off += chunk[i].size;
+  }
+  shoff = PAD4( off + names_size );
+  total = shoff + nb_kept * sizeof( Elf32_Shdr );
+
+  if ( total >= *size ) {
+    free( keep );
+    free( new_index );
+    free( chunk );
+    return elf;
+  }
+
+  if ( ( out = calloc( 1, total ) ) == NULL )
+    fatal_with_errno( "Cannot allocate %d bytes of memory", total );
+  for ( i = 0; i < nb_chunks; i++ )
+    memcpy( out + chunk[i].new, elf + chunk[i].old, chunk[i].size );
+
+  // rebuild the section header table and the section names
+  new_sh = ( Elf32_Shdr * ) ( out + shoff );
+  names_size = 1;
+  for ( i = 0; i < eh->e_shnum; i++ ) {
+    Elf32_Shdr *s;
+    if ( !keep[i] )
+      continue;
+    s = &new_sh[new_index[i]];
+    *s = sh[i];
+    if ( i == 0 )
+      continue;
+
+    if ( sh[i].sh_name < strtab_size ) {
+      int len = strnlen( strtab + sh[i].sh_name,
+                         strtab_size - sh[i].sh_name );
+      memcpy( out + off + names_size, strtab + sh[i].sh_name, len );
+      s->sh_name = names_size;
+      names_size += len + 1;
+    } else
+      s->sh_name = 0;
+
+    if ( i == eh->e_shstrndx ) {
+      s->sh_offset = off;
+      s->sh_addralign = 1;
+    } else if ( sh[i].sh_size || sh[i].sh_type == ELF_SHT_NOBITS )
+      s->sh_offset = map_offset( chunk, nb_chunks, sh[i].sh_offset );
+    else
+      s->sh_offset = off;
+
+    s->sh_link = sh[i].sh_link < eh->e_shnum ? new_index[sh[i].sh_link] : 0;
+    if ( sh[i].sh_type == ELF_SHT_REL || sh[i].sh_type == ELF_SHT_RELA )
+      s->sh_info = new_index[sh[i].sh_info];
+
+    // symbols refer to sections by index
+    if ( sh[i].sh_type == ELF_SHT_SYMTAB ) {
+      Elf32_Sym *sym = ( Elf32_Sym * ) ( out + s->sh_offset );
+      int n = s->sh_size / sizeof( Elf32_Sym );
+      for ( j = 0; j < n; j++ )
+        if ( sym[j].st_shndx && sym[j].st_shndx < ELF_SHN_LORESERVE )
+          sym[j].st_shndx = sym[j].st_shndx < eh->e_shnum &&
+            keep[sym[j].st_shndx] ? new_index[sym[j].st_shndx] : 0;
+    }
+  }
+  new_sh[new_index[eh->e_shstrndx]].sh_size = names_size;
+
+  // finally update the headers
+  eh = ( Elf32_Ehdr * ) out;
+  ph = ( Elf32_Phdr * ) ( out + map_offset( chunk, nb_chunks, eh->e_phoff ) );
+  for ( i = 0; i < eh->e_phnum; i++ )
+    if ( ph[i].p_filesz )
+      ph[i].p_offset = map_offset( chunk, nb_chunks, ph[i].p_offset );
+  if ( eh->e_phnum )
+    eh->e_phoff = map_offset( chunk, nb_chunks, eh->e_phoff );
+  eh->e_shoff = shoff;
+  eh->e_shnum = nb_kept;
+  eh->e_shstrndx = new_index[eh->e_shstrndx];
+
+  *size = total;
+  free( keep );
+  free( new_index );
+  free( chunk );
+  return out;
+}
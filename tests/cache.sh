@@ -0,0 +1,54 @@
+#*---------------------------------------------------------------------*/
+#*    Images are reused from the cache only when intact, and are       */
+#*    never the cache's own read-only files.                           */
+#*---------------------------------------------------------------------*/
+. "$(dirname "$0")/lib.sh"
+
+umask 022
+mkirx A 0101 alpha 0
+mkirx B 0102 beta 1
+listing="Creating ROM image img with the following entries:
+NAME      DATE     VER SIZE DESCRIPTION
+---------------------------------------
+RESET     19700101 -      0 -
+ROMDIR    -        -     96 19700101-000000,dummyconf,img,ps2img@reproducible
+EXTINFO   -        -    120 -
+A         19700101 101  748 alpha
+B         19700101 102  784 beta"
+object=c/78/714f6db310245302bd3d1428c2e7f497b1c647c91482a97f836720a61e0311
+
+expect_output "$listing" ps2img --reproducible --cache=c -v -c -f img A B
+cp img ref
+expect_output "$object
+$object.sha256" sh -c 'find c -type f | sort'
+same img $object
+expect_output "$(sha256sum < img | cut -d' ' -f1)" cat $object.sha256
+expect_output "444
+444" stat -c %a $object $object.sha256
+
+# a fetched image is a file of its own, keeping its permissions
+rm img
+expect_output "$listing
+Image found in cache c" ps2img --reproducible --cache=c -v -c -f img A B
+same img ref
+expect_output "644 1" stat -c '%a %h' img
+chmod 600 img
+expect_output "$listing
+Image found in cache c" ps2img --reproducible --cache=c -v -c -f img A B
+expect_output "600 1" stat -c '%a %h' img
+
+# a cached image that no longer matches its digest is built again
+chmod u+w $object
+printf 'X' | dd of=$object bs=1 seek=100 conv=notrunc 2>/dev/null
+rm img
+expect_output "ps2img: Ignoring corrupted image $object in cache c
+$listing" ps2img --reproducible --cache=c -v -c -f img A B
+same img ref
+same $object ref
+
+# so is one without a digest
+rm img $object.sha256
+expect_output "$listing" ps2img --reproducible --cache=c -v -c -f img A B
+same img ref
+expect_output "$listing
+Image found in cache c" ps2img --reproducible --cache=c -v -c -f img A B
@@ -0,0 +1,58 @@
+#*---------------------------------------------------------------------*/
+#*    An image queried through its index gives the same results as     */
+#*    an image parsed in full, and a stale index is never trusted.     */
+#*---------------------------------------------------------------------*/
+. "$(dirname "$0")/lib.sh"
+
+make_irxs
+listing="NAME      DATE     VER SIZE DESCRIPTION
+---------------------------------------
+RESET     19700101 -      0 -
+ROMDIR    -        -    112 19700101-000000,dummyconf,img,ps2img@reproducible
+EXTINFO   -        -    144 -
+A         19700101 101  748 alpha
+B         19700101 102  784 beta
+C         19700101 203  820 gamma"
+
+ps2img --reproducible -c -f img A B C
+expect_output "$listing" ps2img -t -f img
+ps2img --reproducible --index -c -f img A B C
+[ -f img.idx ] || fail "no index written"
+expect_output "$listing" ps2img -t -f img
+
+mkdir x
+(cd x && ps2img -x -f ../img)
+same x/A A
+same x/B B
+same x/C C
+
+# an image replaced behind the index is parsed again
+mkdir new
+cp A B new
+(cd new && ps2img --reproducible -c -f img B A && mv img ../img)
+expect_output "NAME      DATE     VER SIZE DESCRIPTION
+---------------------------------------
+RESET     19700101 -      0 -
+ROMDIR    -        -     96 19700101-000000,dummyconf,img,ps2img@reproducible
+EXTINFO   -        -    120 -
+B         19700101 102  784 beta
+A         19700101 101  748 alpha" ps2img -t -f img
+rm -r x
+mkdir x
+(cd x && ps2img -x -f ../img)
+same x/A A
+same x/B B
+[ ! -e x/C ] || fail "C extracted from a replaced image"
+
+# an IRX modified in place, with the same size and time, is caught
+ps2img --reproducible --index -c -f img A B C
+cp -p img saved
+size=$(wc -c < img)
+printf 'X' | dd of=img bs=1 seek=$((size - 100)) conv=notrunc 2>/dev/null
+touch -r saved img
+rm -r x
+mkdir x
+(cd x && ps2img -x -f ../img A)
+same x/A A
+expect_failure "ps2img: Entry C of ROM image ../img does not match its index" \
+  sh -c 'cd x && ps2img -x -f ../img C'
@@ -0,0 +1,41 @@
+#*---------------------------------------------------------------------*/
+#*    The .iopmod section of an IRX is found by its exact name.        */
+#*---------------------------------------------------------------------*/
+. "$(dirname "$0")/lib.sh"
+
+mkirx GOOD 0101 good 0
+mkirx LONGER 0102 longer 1 .iopmodx
+mkirx SHORTER 0103 shorter 2 .iopmo
+# ".iop" at the very end of the section names
+mkirx TRUNC 0104 trunc 3 .iop truncated
+
+expect_output "ps2img: LONGER is not a valid IRX
+ps2img: SHORTER is not a valid IRX
+ps2img: TRUNC is not a valid IRX
+GOOD	0101	748	fd5ef8e3bf0c8f69e2cf1faaf39e6870febe097d356e8d8c101e12cb25b5af7c	good	GOOD" \
+  ps2img --inspect GOOD LONGER SHORTER TRUNC
+
+expect_failure "ps2img: Invalid IRX LONGER: .iopmod section not found." \
+  ps2img -c -f img GOOD LONGER
+expect_failure "ps2img: Invalid IRX TRUNC: .iopmod section not found." \
+  ps2img -c -f img GOOD TRUNC
+[ ! -e img ] || fail "an image was created from an invalid IRX"
+
+# stripping keeps the .iopmod section, and drops .comment and .mdebug
+ps2img --reproducible -c -f img GOOD
+expect_output "NAME      DATE     VER SIZE DESCRIPTION
+---------------------------------------
+RESET     19700101 -      0 -
+ROMDIR    -        -     80 19700101-000000,dummyconf,img,ps2img@reproducible
+EXTINFO   -        -     96 -
+GOOD      19700101 101  748 good" ps2img -t -f img
+rm img
+ps2img --reproducible --strip -c -f img GOOD
+expect_output "NAME      DATE     VER SIZE DESCRIPTION
+---------------------------------------
+RESET     19700101 -      0 -
+ROMDIR    -        -     80 19700101-000000,dummyconf,img,ps2img@reproducible
+EXTINFO   -        -     96 -
+GOOD      19700101 101  520 good" ps2img -t -f img
+expect_output "GOOD	0101	748	fd5ef8e3bf0c8f69e2cf1faaf39e6870febe097d356e8d8c101e12cb25b5af7c	good	GOOD" \
+  ps2img --inspect GOOD
@@ -0,0 +1,77 @@
+#*---------------------------------------------------------------------*/
+#*    Common part of the tests run by `make check'.                    */
+#*    -------------------------------------------------------------    */
+#*    A test runs in a scratch directory of its own, with ps2img and   */
+#*    mkirx in the PATH, so that the messages only hold plain names.   */
+#*    It stops at the first check that fails.                          */
+#*---------------------------------------------------------------------*/
+set -e
+
+top=$(cd "$(dirname "$0")/.." && pwd)
+test_name=$(basename "$0" .sh)
+PATH=$top:$top/tests:$PATH
+export PATH
+
+work=$(mktemp -d "${TMPDIR:-/tmp}/ps2img-check.XXXXXX")
+trap 'cd /; rm -rf "$work"' EXIT
+cd "$work"
+
+fail()
+{
+  echo "FAIL: $test_name: $*" >&2
+  exit 1
+}
+
+# expect_output EXPECTED COMMAND...
+# COMMAND must succeed, printing exactly EXPECTED on stdout and stderr
+expect_output()
+{
+  expected=$1
+  shift
+  if ! actual=$("$@" 2>&1); then
+    printf '%s\n' "$actual" >&2
+    fail "$* failed"
+  fi
+  if [ "$actual" != "$expected" ]; then
+    printf 'expected:\n%s\ngot:\n%s\n' "$expected" "$actual" >&2
+    fail "wrong output from $*"
+  fi
+}
+
+# expect_failure EXPECTED COMMAND...
+# COMMAND must fail, printing exactly EXPECTED on stdout and stderr
+expect_failure()
+{
+  expected=$1
+  shift
+  if actual=$("$@" 2>&1); then
+    printf '%s\n' "$actual" >&2
+    fail "$* succeeded"
+  fi
+  if [ "$actual" != "$expected" ]; then
+    printf 'expected:\n%s\ngot:\n%s\n' "$expected" "$actual" >&2
+    fail "wrong output from $*"
+  fi
+}
+
+# same FILE1 FILE2
+same()
+{
+  cmp -s "$1" "$2" || fail "$1 and $2 differ"
+}
+
+# differ FILE1 FILE2
+differ()
+{
+  if cmp -s "$1" "$2"; then
+    fail "$1 and $2 are identical"
+  fi
+}
+
+# A, B and C, with distinct contents, versions and descriptions
+make_irxs()
+{
+  mkirx A 0101 alpha 0
+  mkirx B 0102 beta 1
+  mkirx C 0203 gamma 2
+}
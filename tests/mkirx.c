@@ -0,0 +1,222 @@
+/**
+ * ps2img - Create, inspect or extract Playstation 2 ROM image files
+ * Copyright (c) 2005 Damien Ciabrini (dciabrin), Olivier Parra (yo6)
+ *
+ *     ps2img is free software; you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as
+ *     published by the Free Software Foundation; either version 2 of
+ *     the License, or (at your option) any later version.
+ *
+ *     ps2img is distributed in the hope that it will be useful, but
+ *     WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public
+ *     License along with ps2img; if not, write to the Free Software
+ *     Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *     02111-1307 USA
+ *
+ * $Id$
+ */
+
+/*---------------------------------------------------------------------*/
+/*    mkirx: write a small IRX for the tests of `make check'.          */
+/*    -------------------------------------------------------------    */
+/*    Usage: mkirx FILE VERSION DESCR [SEED [IOPMOD [truncated]]]      */
+/*    The IRX has a .text section of 150 + 37 * SEED bytes whose       */
+/*    contents depend on SEED, relocations, the .iopmod section        */
+/*    giving VERSION (hexadecimal) and DESCR, and the .comment and     */
+/*    .mdebug sections that --strip drops. IOPMOD renames the          */
+/*    .iopmod section; with truncated, its name ends the table of      */
+/*    section names, without its terminating null byte.                */
+/*---------------------------------------------------------------------*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#define NB_SECTIONS 7
+#define EHDR_SIZE 52
+#define PHDR_SIZE 32
+#define SHDR_SIZE 40
+
+typedef struct
+{
+  const char *name;
+  unsigned type;
+  unsigned flags;
+  unsigned char *data;
+  unsigned size;
+} section_t;
+
+static unsigned char image[0x10000];
+static unsigned image_size;
+
+static void put( const void *data, unsigned size )
+{
+  if ( image_size + size > sizeof( image ) ) {
+    fprintf( stderr, "mkirx: IRX too big\n" );
+    exit( 1 );
+  }
+  memcpy( image + image_size, data, size );
+  image_size += size;
+}
+
+static void put_le16( unsigned v )
+{
+  unsigned char b[2] = { v, v >> 8 };
+  put( b, 2 );
+}
+
+static void put_le32( unsigned v )
+{
+  unsigned char b[4] = { v, v >> 8, v >> 16, v >> 24 };
+  put( b, 4 );
+}
+
+static void align4(  )
+{
+  while ( image_size % 4 )
+    put( "", 1 );
+}
+
+int main( int argc, char *argv[] )
+{
+  static unsigned char text[0x8000], iopmod[512], comment[80];
+  static unsigned char rel[16], mdebug[64], names[256];
+  unsigned offset[NB_SECTIONS], name[NB_SECTIONS];
+  unsigned version, seed = 0, text_size, i, n, shoff;
+  const char *descr, *iopmod_name = ".iopmod";
+  unsigned names_size = 1;
+  int truncated = 0;
+  section_t s[NB_SECTIONS];
+  FILE *f;
+
+  if ( argc < 4 || argc > 7 ||
+       ( argc == 7 && strcmp( argv[6], "truncated" ) != 0 ) ) {
+    fprintf( stderr, "Usage: mkirx FILE VERSION DESCR "
+             "[SEED [IOPMOD [truncated]]]\n" );
+    return 1;
+  }
+  version = strtoul( argv[2], NULL, 16 );
+  descr = argv[3];
+  if ( argc > 4 )
+    seed = atoi( argv[4] );
+  if ( argc > 5 )
+    iopmod_name = argv[5];
+  truncated = argc > 6;
+  text_size = 150 + 37 * seed;
+  if ( text_size > sizeof( text ) || strlen( descr ) > 256 ) {
+    fprintf( stderr, "mkirx: IRX too big\n" );
+    return 1;
+  }
+
+  for ( i = 0; i < text_size; i++ )
+    text[i] = i * 7 + seed;
+  // .iopmod: module info, text size, then version and description
+  memset( iopmod, 0, 24 );
+  iopmod[0] = 0x34;
+  iopmod[1] = 0x12;
+  iopmod[12] = text_size;
+  iopmod[13] = text_size >> 8;
+  iopmod[24] = version >> 8;
+  iopmod[25] = version;
+  strcpy( ( char * ) iopmod + 26, descr );
+  for ( i = 0; i < 4; i++ )
+    memcpy( comment + 17 * i, "GCC: (GNU) 3.2.2", 17 );
+  memset( mdebug, 0xaa, sizeof( mdebug ) );
+
+  memset( s, 0, sizeof( s ) );
+  s[1] = ( section_t ) { ".text", 1, 6, text, text_size };
+  s[2] = ( section_t ) { ".rel.text", 9, 0, rel, sizeof( rel ) };
+  s[3] = ( section_t ) { iopmod_name, 0x70000080, 0, iopmod,
+    27 + strlen( descr ) };
+  s[4] = ( section_t ) { ".comment", 1, 0, comment, 68 };
+  s[5] = ( section_t ) { ".mdebug", 0x70000005, 0, mdebug,
+    sizeof( mdebug ) };
+  s[6] = ( section_t ) { ".shstrtab", 3, 0, names, 0 };
+  for ( i = 1; i < NB_SECTIONS; i++ ) {
+    if ( truncated && i == 3 )
+      continue;
+    n = strlen( s[i].name ) + 1;
+    if ( names_size + n > sizeof( names ) ) {
+      fprintf( stderr, "mkirx: section name too long\n" );
+      return 1;
+    }
+    name[i] = names_size;
+    memcpy( names + names_size, s[i].name, n );
+    names_size += n;
+  }
+  if ( truncated ) {
+    n = strlen( s[3].name );
+    if ( names_size + n > sizeof( names ) ) {
+      fprintf( stderr, "mkirx: section name too long\n" );
+      return 1;
+    }
+    name[3] = names_size;
+    memcpy( names + names_size, s[3].name, n );
+    names_size += n;
+  }
+  s[6].size = names_size;
+
+  // ELF header, for a MIPS IRX with a single program header
+  put( "\177ELF\1\1\1", 7 );
+  put( "\0\0\0\0\0\0\0\0\0", 9 );
+  put_le16( 0xff80 );
+  put_le16( 8 );
+  put_le32( 1 );
+  put_le32( 0 );
+  put_le32( EHDR_SIZE );
+  put_le32( 0 );                // section headers, patched below
+  put_le32( 0 );
+  put_le16( EHDR_SIZE );
+  put_le16( PHDR_SIZE );
+  put_le16( 1 );
+  put_le16( SHDR_SIZE );
+  put_le16( NB_SECTIONS );
+  put_le16( NB_SECTIONS - 1 );
+
+  put_le32( 1 );
+  put_le32( EHDR_SIZE + PHDR_SIZE );
+  put_le32( 0 );
+  put_le32( 0 );
+  put_le32( text_size );
+  put_le32( text_size );
+  put_le32( 7 );
+  put_le32( 16 );
+
+  for ( i = 1; i < NB_SECTIONS; i++ ) {
+    align4(  );
+    offset[i] = image_size;
+    put( s[i].data, s[i].size );
+  }
+  align4(  );
+
+  shoff = image_size;
+  image[32] = shoff;
+  image[33] = shoff >> 8;
+  image[34] = shoff >> 16;
+  image[35] = shoff >> 24;
+  for ( i = 0; i < 10; i++ )
+    put_le32( 0 );
+  for ( i = 1; i < NB_SECTIONS; i++ ) {
+    put_le32( name[i] );
+    put_le32( s[i].type );
+    put_le32( s[i].flags );
+    put_le32( 0 );
+    put_le32( offset[i] );
+    put_le32( s[i].size );
+    put_le32( 0 );
+    put_le32( i == 2 ? 1 : 0 );
+    put_le32( 4 );
+    put_le32( i == 2 ? 8 : 0 );
+  }
+
+  if ( ( f = fopen( argv[1], "wb" ) ) == NULL ||
+       fwrite( image, image_size, 1, f ) != 1 || fclose( f ) != 0 ) {
+    perror( argv[1] );
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,46 @@
+#*---------------------------------------------------------------------*/
+#*    Unpacking gives back the packed images byte for byte.            */
+#*---------------------------------------------------------------------*/
+. "$(dirname "$0")/lib.sh"
+
+make_irxs
+ps2img --reproducible -c -f i1 A B C
+ps2img --reproducible -z -c -f i2 A B
+ps2img --reproducible -z -c -f i3 B C
+# the same stream, but another operating system in the gzip header
+ps2img --reproducible -z -c -f i4 A C
+printf '\377' | dd of=i4 bs=1 seek=9 conv=notrunc 2>/dev/null
+mkdir orig
+cp i1 i2 i3 i4 orig
+
+expect_output "Packing i1 (3 IRXs)
+Packing i2 (2 IRXs)
+Packing i3 (2 IRXs)
+Packing i4 (verbatim, not compressed again identically)
+Pack p: 4 images, 3 distinct IRXs, 4177 bytes" \
+  ps2img -v --pack -f p i1 i2 i3 i4
+
+rm i1 i2 i3 i4
+expect_output "Unpacking i1 (3 IRXs)
+Unpacking i2 (2 IRXs)
+Unpacking i3 (2 IRXs)
+Unpacking i4 (verbatim)" ps2img -v --unpack -f p
+for i in i1 i2 i3 i4; do
+  same $i orig/$i
+done
+
+ps2img --unpack -f p i2 -o other
+same other orig/i2
+expect_failure "ps2img: Image nope not found in pack p" \
+  ps2img --unpack -f p nope
+
+# the checks of the pack
+expect_failure "ps2img: Invalid image name $work/i1 in pack q: absolute file name" \
+  ps2img --pack -f q "$work/i1"
+expect_failure "ps2img: A is not a valid pack" ps2img --unpack -f A
+cp p corrupted
+printf 'X' | dd of=corrupted bs=1 seek=300 conv=notrunc 2>/dev/null
+rm i1
+expect_failure "ps2img: corrupted is corrupted: wrong contents for image i1" \
+  ps2img --unpack -f corrupted i1
+[ ! -e i1 ] || fail "an image was unpacked from a corrupted pack"
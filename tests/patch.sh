@@ -0,0 +1,38 @@
+#*---------------------------------------------------------------------*/
+#*    A patch rebuilds the new image exactly, and only applies to      */
+#*    the old image it was made from.                                  */
+#*---------------------------------------------------------------------*/
+. "$(dirname "$0")/lib.sh"
+
+make_irxs
+mkdir old new newz
+cp A B old
+cp A C new
+cp A C newz
+(cd old && ps2img --reproducible -c -f img A B)
+(cd new && ps2img --reproducible -c -f img A C)
+(cd newz && ps2img --reproducible -z -c -f img A C)
+
+expect_output "Storing C       (820 bytes)
+Patch p: 1 IRXs copied from old/img, 1 stored, 1172 bytes" \
+  ps2img -v --mkpatch old/img new/img -o p
+expect_output "Patching C       (820 bytes)" ps2img -v --patch old/img p -o img
+same img new/img
+
+ps2img --mkpatch old/img newz/img -o pz
+ps2img --patch old/img pz -o imgz
+same imgz newz/img
+
+# the checks of the patch
+expect_failure "ps2img: Patch p does not apply to ROM image new/img" \
+  ps2img --patch new/img p -o bad
+expect_failure "ps2img: A is not a valid ROM image patch" \
+  ps2img --patch old/img A -o bad
+head -c 200 p > truncated
+expect_failure "ps2img: truncated is truncated or corrupted" \
+  ps2img --patch old/img truncated -o bad
+cp p corrupted
+printf 'X' | dd of=corrupted bs=1 seek=1000 conv=notrunc 2>/dev/null
+expect_failure "ps2img: Patch corrupted is corrupted: wrong resulting image" \
+  ps2img --patch old/img corrupted -o bad
+[ ! -e bad ] || fail "an image was written by a patch that does not apply"
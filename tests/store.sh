@@ -0,0 +1,60 @@
+#*---------------------------------------------------------------------*/
+#*    The store holds each distinct IRX once, intact, and extracted    */
+#*    entries are links to it.                                         */
+#*---------------------------------------------------------------------*/
+. "$(dirname "$0")/lib.sh"
+
+umask 022
+mkirx A 0101 alpha 0
+mkirx B 0102 beta 1
+cp A D
+a=s/ee/99c5a6dc80c280719c18ccbfd8eaa96c9485b365485e07ecb09dadba6a3d5b
+b=s/4c/38ba8e15588bd457120f3c23d3ee544882486ae4a7d85fa693c6b7a20470b8
+ps2img --reproducible -c -f img A B D
+
+# inode and link count of a file
+links()
+{
+  stat -c '%i %h' "$1"
+}
+
+mkdir x
+expect_output "Extracting A    (748 bytes)
+Extracting B    (784 bytes)
+Extracting D    (748 bytes)" sh -c 'cd x && ps2img -v --store=../s -x -f ../img'
+expect_output "$b
+$a" sh -c 'find s -type f | sort'
+expect_output "444
+444" stat -c %a $a $b
+same $a A
+same $b B
+expect_output "$(links $a)" links x/A
+expect_output "$(links $a)" links x/D
+expect_output "$(links $b)" links x/B
+expect_output "3" stat -c %h $a
+
+# extracting again leaves everything in place
+before="$(links x/A) $(links x/B) $(links x/D)"
+(cd x && ps2img --store=../s -x -f ../img)
+[ "$before" = "$(links x/A) $(links x/B) $(links x/D)" ] ||
+  fail "extracted entries replaced"
+
+# an object modified in place is written anew, and linked again
+chmod u+w $a
+printf 'X' | dd of=$a bs=1 seek=100 conv=notrunc 2>/dev/null
+(cd x && ps2img --store=../s -x -f ../img)
+same $a A
+same x/A A
+same x/D A
+expect_output "$(links $a)" links x/A
+expect_output "$(links $a)" links x/D
+expect_output "444" stat -c %a $a
+
+# entries read through an index go to the same objects
+ps2img --reproducible --index -c -f img A B D
+mkdir y
+(cd y && ps2img --store=../s -x -f ../img)
+expect_output "$b
+$a" sh -c 'find s -type f | sort'
+expect_output "$(links $a)" links y/A
+expect_output "$(links $b)" links y/B
@@ -0,0 +1,206 @@
+/**
+ * ps2img - Create, inspect or extract Playstation 2 ROM image files
+ * Copyright (c) 2005 Damien Ciabrini (dciabrin), Olivier Parra (yo6)
+ *
+ *     ps2img is free software; you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as
+ *     published by the Free Software Foundation; either version 2 of
+ *     the License, or (at your option) any later version.
+ *
+ *     ps2img is distributed in the hope that it will be useful, but
+ *     WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public
+ *     License along with ps2img; if not, write to the Free Software
+ *     Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *     02111-1307 USA
+ *
+ * $Id$
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "common.h"
+
+
+#ifdef TRACE
+
+/*---------------------------------------------------------------------*/
+/*    The trace ring buffer ...                                        */
+/*    -------------------------------------------------------------    */
+/*    Threads claim slots with an atomic increment, so recording an    */
+/*    event takes no lock. When the buffer is full the oldest events   */
+/*    are overwritten.                                                 */
+/*---------------------------------------------------------------------*/
+#define TRACE_RING_SIZE 0x10000
+#define TRACE_ARG_SIZE  48
+
+typedef struct
+{
+  long long ts;
+  int tid;
+  char phase;
+  const char *name;
+  char arg[TRACE_ARG_SIZE];
+} trace_event_t;
+
+int trace_enabled;
+static trace_event_t *trace_ring;
+static unsigned trace_next;
+static char *trace_file;
+static pid_t trace_pid;
+
+// Spans open in the current thread, innermost last
+#define TRACE_MAX_DEPTH 32
+static __thread const char *trace_span[TRACE_MAX_DEPTH];
+static __thread int trace_depth;
+
+
+void trace_event( char phase, const char *name, const char *arg )
+{
+  trace_event_t *e;
+  struct timespec now;
+  int len;
+
+  clock_gettime( CLOCK_MONOTONIC, &now );
+  e = &trace_ring[__sync_fetch_and_add( &trace_next, 1 ) %
+                  TRACE_RING_SIZE];
+  e->ts = now.tv_sec * 1000000000LL + now.tv_nsec;
+  e->tid = syscall( SYS_gettid );
+  e->phase = phase;
+  e->name = name;
+
+  if ( phase == 'B' ) {
+    if ( trace_depth < TRACE_MAX_DEPTH )
+      trace_span[trace_depth] = name;
+    trace_depth++;
+  } else if ( trace_depth > 0 )
+    trace_depth--;
+
+  // keep the end of long arguments, where file names are
+  if ( arg == NULL )
+    arg = "";
+  len = strlen( arg );
+  if ( len >= TRACE_ARG_SIZE )
+    arg += len - TRACE_ARG_SIZE + 1;
+  strcpy( e->arg, arg );
+}
+
+
+/*---------------------------------------------------------------------*/
+/*    trace_unwind ...                                                 */
+/*    -------------------------------------------------------------    */
+/*    End the spans open in the current thread, innermost first.       */
+/*---------------------------------------------------------------------*/
+void trace_unwind( void )
+{
+  while ( trace_depth > 0 )
+    trace_event( 'E', trace_depth <= TRACE_MAX_DEPTH ?
+                 trace_span[trace_depth - 1] : "unwind", NULL );
+}
+
+
+/*---------------------------------------------------------------------*/
+/*    trace_dump_string ...                                            */
+/*---------------------------------------------------------------------*/
+static void trace_dump_string( FILE * f, const char *s )
+{
+  fputc( '"', f );
+  for ( ; *s; s++ ) {
+    if ( *s == '"' || *s == '\\' )
+      fprintf( f, "\\%c", *s );
+    else if ( ( unsigned char ) *s < 0x20 )
+      fprintf( f, "\\u%04x", *s );
+    else
+      fputc( *s, f );
+  }
+  fputc( '"', f );
+}
+
+
+/*---------------------------------------------------------------------*/
+/*    trace_dump ...                                                   */
+/*    -------------------------------------------------------------    */
+/*    Save the events of the ring buffer in the Chrome trace event     */
+/*    format, which Perfetto and chrome://tracing can load.            */
+/*---------------------------------------------------------------------*/
+static void trace_dump(  )
+{
+  unsigned first, last, i;
+  FILE *f;
+
+  // forked processes inherit the buffer, only its owner saves it
+  if ( !trace_enabled || getpid(  ) != trace_pid )
+    return;
+  trace_enabled = 0;
+
+  if ( ( f = fopen( trace_file, "w" ) ) == NULL ) {
+    warning( "Cannot create trace file %s", trace_file );
+    return;
+  }
+
+  last = trace_next;
+  first = last > TRACE_RING_SIZE ? last - TRACE_RING_SIZE : 0;
+  fprintf( f, "{\"traceEvents\":[\n" );
+  for ( i = first; i < last; i++ ) {
+    trace_event_t *e = &trace_ring[i % TRACE_RING_SIZE];
+    fprintf( f, "{\"name\":" );
+    trace_dump_string( f, e->name );
+    fprintf( f, ",\"ph\":\"%c\",\"ts\":%lld.%03lld,\"pid\":%d,\"tid\":%d",
+             e->phase, e->ts / 1000, e->ts % 1000, ( int ) trace_pid,
+             e->tid );
+    if ( e->arg[0] ) {
+      fprintf( f, ",\"args\":{\"arg\":" );
+      trace_dump_string( f, e->arg );
+      fprintf( f, "}" );
+    }
+    fprintf( f, "}%s\n", i + 1 < last ? "," : "" );
+  }
+  fprintf( f, "],\"displayTimeUnit\":\"ns\"}\n" );
+
+  if ( fclose( f ) == EOF )
+    warning( "Cannot write trace file %s", trace_file );
+}
+
+
+/*---------------------------------------------------------------------*/
+/*    trace_open ...                                                   */
+/*    -------------------------------------------------------------    */
+/*    Start recording events, to be saved in trace_file at exit.       */
+/*---------------------------------------------------------------------*/
+void trace_open( const char *file )
+{
+  static int registered;
+
+  if ( trace_ring == NULL &&
+       ( trace_ring = malloc( TRACE_RING_SIZE * sizeof( trace_event_t ) ) )
+       == NULL )
+    fatal_with_errno( "Cannot allocate the trace buffer" );
+  free( trace_file );
+  if ( ( trace_file = strdup( file ) ) == NULL )
+    fatal_with_errno( "Cannot allocate memory" );
+  trace_next = 0;
+  trace_depth = 0;
+  trace_pid = getpid(  );
+  trace_enabled = 1;
+
+  if ( !registered && atexit( trace_dump ) == 0 )
+    registered = 1;
+}
+
+#else
+
+void trace_open( const char *file )
+{
+  fatal( "Cannot trace to %s: %s was built without -DTRACE", file,
+         program_name );
+}
+
+#endif
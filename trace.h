@@ -0,0 +1,70 @@
+/**
+ * ps2img - Create, inspect or extract Playstation 2 ROM image files
+ * Copyright (c) 2005 Damien Ciabrini (dciabrin), Olivier Parra (yo6)
+ *
+ *     ps2img is free software; you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as
+ *     published by the Free Software Foundation; either version 2 of
+ *     the License, or (at your option) any later version.
+ *
+ *     ps2img is distributed in the hope that it will be useful, but
+ *     WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public
+ *     License along with ps2img; if not, write to the Free Software
+ *     Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *     02111-1307 USA
+ *
+ * $Id$
+ */
+
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+/*---------------------------------------------------------------------*/
+/*    Tracing ...                                                      */
+/*    -------------------------------------------------------------    */
+/*    TRACE_BEGIN and TRACE_END delimit a span of time, named after    */
+/*    the work done and, optionally, the file or entry it is done on.  */
+/*    Spans are recorded in a ring buffer once trace_open has been     */
+/*    called, and saved as Chrome trace events when the program        */
+/*    exits. Unless built with -DTRACE, they compile to nothing.       */
+/*---------------------------------------------------------------------*/
+#ifdef TRACE
+
+extern int trace_enabled;
+void trace_event (char phase, const char *name, const char *arg);
+void trace_unwind (void);
+
+#define TRACE_BEGIN( name, arg )                \
+  do {                                          \
+    if ( trace_enabled )                        \
+      trace_event( 'B', name, arg );            \
+  } while ( 0 )
+
+#define TRACE_END( name )                       \
+  do {                                          \
+    if ( trace_enabled )                        \
+      trace_event( 'E', name, NULL );           \
+  } while ( 0 )
+
+// end the spans a fatal error leaves open when it unwinds
+#define TRACE_UNWIND(  )                        \
+  do {                                          \
+    if ( trace_enabled )                        \
+      trace_unwind(  );                         \
+  } while ( 0 )
+
+#else
+
+#define TRACE_BEGIN( name, arg ) do { } while ( 0 )
+#define TRACE_END( name ) do { } while ( 0 )
+#define TRACE_UNWIND(  ) do { } while ( 0 )
+
+#endif
+
+void trace_open (const char *trace_file);
+
+#endif
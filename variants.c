@@ -0,0 +1,186 @@
+/**
+ * ps2img - Create, inspect or extract Playstation 2 ROM image files
+ * Copyright (c) 2005 Damien Ciabrini (dciabrin), Olivier Parra (yo6)
+ *
+ *     ps2img is free software; you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as
+ *     published by the Free Software Foundation; either version 2 of
+ *     the License, or (at your option) any later version.
+ *
+ *     ps2img is distributed in the hope that it will be useful, but
+ *     WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public
+ *     License along with ps2img; if not, write to the Free Software
+ *     Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *     02111-1307 USA
+ *
+ * $Id$
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "common.h"
+
+#include <unistd.h>
+
+extern void create_image( char *image_name, char *irx_args[], int num_irx );
+extern void init_entry_from_irx( entry_t * entry, char *irx );
+
+
+/*---------------------------------------------------------------------*/
+/*    Variant manifests:                                               */
+/*    -------------------------------------------------------------    */
+/*    A manifest lists the images to build, one per line: the name     */
+/*    of the image followed by its IRX files, in order. Blank lines    */
+/*    and lines starting with # are ignored.                           */
+/*---------------------------------------------------------------------*/
+typedef struct
+{
+  char *image_name;
+  char **irx;
+  int num_irx;
+} variant_t;
+
+typedef struct
+{
+  variant_t *variant;
+  int nb_variants;
+  int next;
+  pthread_mutex_t lock;
+} manifest_t;
+
+
+/*---------------------------------------------------------------------*/
+/*    read_manifest ...                                                */
+/*---------------------------------------------------------------------*/
+static void read_manifest( char *name, manifest_t * m )
+{
+  char *buf = NULL;
+  size_t buf_size = 0;
+  int allocated = 0;
+  int line = 0;
+  FILE *f;
+
+  if ( strcmp( name, "-" ) == 0 )
+    f = stdin;
+  else if ( ( f = fopen( name, "r" ) ) == NULL )
+    fatal_with_errno( "Cannot open file %s", name );
+
+  while ( getline( &buf, &buf_size, f ) != -1 ) {
+    char *tok, *save;
+    variant_t v;
+    int i, allocated_irx = 8;
+
+    line++;
+    if ( ( tok = strtok_r( buf, " \t\r\n", &save ) ) == NULL || tok[0] == '#' )
+      continue;
+
+    v.image_name = strdup( tok );
+    v.num_irx = 0;
+    if ( ( v.irx = malloc( allocated_irx * sizeof( char * ) ) ) == NULL )
+      fatal_with_errno( "Cannot allocate memory" );
+    while ( ( tok = strtok_r( NULL, " \t\r\n", &save ) ) != NULL ) {
+      if ( v.num_irx == allocated_irx ) {
+        allocated_irx *= 2;
+        if ( ( v.irx =
+               realloc( v.irx, allocated_irx * sizeof( char * ) ) ) == NULL )
+          fatal_with_errno( "Cannot allocate memory" );
+      }
+      v.irx[v.num_irx++] = strdup( tok );
+    }
+    if ( v.num_irx == 0 )
+      fatal( "%s:%d: refusing to create the empty archive %s", name, line,
+             v.image_name );
+
+    for ( i = 0; i < m->nb_variants; i++ )
+      if ( strcmp( m->variant[i].image_name, v.image_name ) == 0 )
+        fatal( "%s:%d: image %s is listed twice", name, line, v.image_name );
+
+    if ( m->nb_variants == allocated ) {
+      allocated = allocated ? allocated * 2 : 16;
+      if ( ( m->variant =
+             realloc( m->variant, allocated * sizeof( variant_t ) ) ) == NULL )
+        fatal_with_errno( "Cannot allocate memory" );
+    }
+    m->variant[m->nb_variants++] = v;
+  }
+
+  if ( ferror( f ) )
+    fatal_with_errno( "Cannot read file %s", name );
+  if ( f != stdin )
+    fclose( f );
+  free( buf );
+}
+
+
+/*---------------------------------------------------------------------*/
+/*    variant_worker ...                                               */
+/*    -------------------------------------------------------------    */
+/*    Thread body: build images until none is left.                    */
+/*---------------------------------------------------------------------*/
+static void *variant_worker( void *arg )
+{
+  manifest_t *m = arg;
+  for ( ;; ) {
+    pthread_mutex_lock( &m->lock );
+    int i = m->next++;
+    pthread_mutex_unlock( &m->lock );
+    if ( i >= m->nb_variants )
+      return NULL;
+    create_image( m->variant[i].image_name, m->variant[i].irx,
+                  m->variant[i].num_irx );
+  }
+}
+
+
+/*---------------------------------------------------------------------*/
+/*    build_variants ...                                               */
+/*    -------------------------------------------------------------    */
+/*    Build all the images listed in a manifest. Every distinct IRX    */
+/*    is loaded and parsed once, into the IRX cache, and the images    */
+/*    are then written in parallel from the cached IRXs.               */
+/*---------------------------------------------------------------------*/
+void build_variants( char *manifest )
+{
+  manifest_t m;
+  entry_t entry;
+  int i, j, nb_threads;
+  int was_verbose = verbose;
+
+  memset( &m, 0, sizeof( m ) );
+  pthread_mutex_init( &m.lock, NULL );
+  read_manifest( manifest, &m );
+
+  irx_cache_enable(  );
+  for ( i = 0; i < m.nb_variants; i++ )
+    for ( j = 0; j < m.variant[i].num_irx; j++ )
+      init_entry_from_irx( &entry, m.variant[i].irx[j] );
+
+  nb_threads = sysconf( _SC_NPROCESSORS_ONLN );
+  if ( nb_threads < 1 )
+    nb_threads = 1;
+  if ( nb_threads > m.nb_variants )
+    nb_threads = m.nb_variants;
+
+  // the images are listed once they are all built, which also keeps
+  // the threads from setting the shared verbose formats
+  verbose = 0;
+  pthread_t threads[nb_threads > 0 ? nb_threads : 1];
+  for ( i = 0; i < nb_threads; i++ )
+    if ( pthread_create( &threads[i], NULL, variant_worker, &m ) != 0 )
+      fatal( "Cannot create build thread" );
+  for ( i = 0; i < nb_threads; i++ )
+    pthread_join( threads[i], NULL );
+  verbose = was_verbose;
+
+  if ( verbose )
+    for ( i = 0; i < m.nb_variants; i++ )
+      printf( "Created ROM image %s (%d IRXs)\n", m.variant[i].image_name,
+              m.variant[i].num_irx );
+}
@@ -0,0 +1,174 @@
+/**
+ * ps2img - Create, inspect or extract Playstation 2 ROM image files
+ * Copyright (c) 2005 Damien Ciabrini (dciabrin), Olivier Parra (yo6)
+ *
+ *     ps2img is free software; you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as
+ *     published by the Free Software Foundation; either version 2 of
+ *     the License, or (at your option) any later version.
+ *
+ *     ps2img is distributed in the hope that it will be useful, but
+ *     WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public
+ *     License along with ps2img; if not, write to the Free Software
+ *     Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *     02111-1307 USA
+ *
+ * $Id$
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include "common.h"
+
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+
+extern void create_image( char *image_name, char *irx_args[], int num_irx );
+
+// Quiet time to wait for after a change before rebuilding, in ms
+#define WATCH_DEBOUNCE_DELAY 250
+
+#define WATCH_EVENTS ( IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | \
+                       IN_DELETE | IN_ATTRIB )
+
+
+/*---------------------------------------------------------------------*/
+/*    The watched IRX structure ...                                    */
+/*    -------------------------------------------------------------    */
+/*    IRXs are watched through their directory, as compilers and       */
+/*    editors often replace files instead of rewriting them.           */
+/*---------------------------------------------------------------------*/
+typedef struct
+{
+  int wd;
+  char *name;
+} watched_irx_t;
+
+
+/*---------------------------------------------------------------------*/
+/*    rebuild_image ...                                                */
+/*    -------------------------------------------------------------    */
+/*    Build the image, reporting errors without exiting, since an      */
+/*    IRX may be caught in the middle of its own build. What the       */
+/*    failed build held is released by the cleanups of fatal.          */
+/*---------------------------------------------------------------------*/
+static void rebuild_image( char *image_name, char *irx_args[], int num_irx )
+{
+  jmp_buf recovery;
+
+  fflush( stdout );
+  fatal_recovery = &recovery;
+  if ( !setjmp( recovery ) ) {
+    create_image( image_name, irx_args, num_irx );
+    if ( verbose )
+      printf( "Built ROM image %s\n", image_name );
+  }
+  fatal_recovery = NULL;
+  irx_cache_collect(  );
+  fflush( stdout );
+}
+
+
+/*---------------------------------------------------------------------*/
+/*    read_events ...                                                  */
+/*    -------------------------------------------------------------    */
+/*    Read pending inotify events. Returns 1 if one of them is about   */
+/*    a watched IRX.                                                   */
+/*---------------------------------------------------------------------*/
+static int read_events( int fd, watched_irx_t * w, int num_irx )
+{
+  char buf[4096]
+    __attribute__ ( ( aligned( __alignof__( struct inotify_event ) ) ) );
+  ssize_t n;
+  char *p;
+  int i, changed = 0;
+
+  if ( ( n = read( fd, buf, sizeof( buf ) ) ) == -1 ) {
+    if ( errno == EINTR || errno == EAGAIN )
+      return 0;
+    fatal_with_errno( "Cannot read file system events" );
+  }
+
+  for ( p = buf; p < buf + n;
+        p += sizeof( struct inotify_event ) +
+        ( ( struct inotify_event * ) p )->len ) {
+    struct inotify_event *ev = ( struct inotify_event * ) p;
+    // events were lost: any IRX may have changed
+    if ( ev->mask & IN_Q_OVERFLOW ) {
+      if ( verbose && !changed )
+        printf( "Too many changes, rebuilding\n" );
+      changed = 1;
+      continue;
+    }
+    if ( ev->len == 0 )
+      continue;
+    for ( i = 0; i < num_irx; i++ )
+      if ( w[i].wd == ev->wd && strcmp( w[i].name, ev->name ) == 0 ) {
+        if ( verbose && !changed )
+          printf( "%s changed\n", ev->name );
+        changed = 1;
+      }
+  }
+  return changed;
+}
+
+
+/*---------------------------------------------------------------------*/
+/*    watch_image ...                                                  */
+/*    -------------------------------------------------------------    */
+/*    Build an image, then rebuild it whenever one of its IRXs         */
+/*    changes. The IRXs are kept in the IRX cache between builds,      */
+/*    so that only the ones that changed are read and parsed again.    */
+/*---------------------------------------------------------------------*/
+void watch_image( char *image_name, char *irx_args[], int num_irx )
+{
+  watched_irx_t w[num_irx];
+  struct pollfd pfd;
+  int fd, i;
+
+  irx_cache_enable(  );
+
+  if ( ( fd = inotify_init1( IN_NONBLOCK | IN_CLOEXEC ) ) == -1 )
+    fatal_with_errno( "Cannot watch file system events" );
+
+  for ( i = 0; i < num_irx; i++ ) {
+    char *dir = strdup( irx_args[i] );
+    char *name = basename( dir );
+    if ( name == dir )
+      dir = ".";
+    else
+      name[-1] = '\0';
+    if ( ( w[i].wd = inotify_add_watch( fd, *dir ? dir : "/",
+                                        WATCH_EVENTS ) ) == -1 )
+      fatal_with_errno( "Cannot watch directory %s", dir );
+    w[i].name = basename( irx_args[i] );
+  }
+
+  rebuild_image( image_name, irx_args, num_irx );
+
+  pfd.fd = fd;
+  pfd.events = POLLIN;
+  for ( ;; ) {
+    if ( poll( &pfd, 1, -1 ) == -1 ) {
+      if ( errno == EINTR )
+        continue;
+      fatal_with_errno( "Cannot watch file system events" );
+    }
+    if ( !read_events( fd, w, num_irx ) )
+      continue;
+
+    // wait for the changes to settle down
+    while ( poll( &pfd, 1, WATCH_DEBOUNCE_DELAY ) > 0 )
+      read_events( fd, w, num_irx );
+
+    rebuild_image( image_name, irx_args, num_irx );
+  }
+}
@@ -21,32 +21,16 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "common.h"
+#include "sha256.h"
 
+#include <fcntl.h>
+#include <unistd.h>
 
 
-/*---------------------------------------------------------------------*/
-/*    write_file ...                                                   */
-/*    -------------------------------------------------------------    */
-/*    Store a block of memory to a file.                               */
-/*---------------------------------------------------------------------*/
-void write_file( const char *irx, unsigned char *data, int size )
-{
-  FILE *f;
-
-  if ( ( f = fopen( irx, "w" ) ) == NULL )
-    fatal_with_errno( "Cannot create file %s", irx );
-
-  if ( fwrite( data, size, 1, f ) != 1 )
-    fatal_with_errno( "Cannot write to file %s", irx );
-
-  if ( fclose( f ) == -1 )
-    fatal_with_errno( "Cannot close file %s", irx );
-
-}
-
 
 /*---------------------------------------------------------------------*/
 /*    verbose_print_extract_message                                    */
@@ -89,6 +73,8 @@ fill_entry_descriptors( char *image_file, char *img, int img_size,
   int max_name = 0;
   int i;
 
+  TRACE_BEGIN( "fill_entry_descriptors", image_file );
+
   // Check file integrity
   if ( ( img_size < ( 16 * 3 ) ) ||
        img[0] != 'R' ||
@@ -112,10 +98,10 @@ fill_entry_descriptors( char *image_file, char *img, int img_size,
   entries = malloc( sizeof( entry_t ) * nb_entries );
 
   // fill the resulting entries w.r.t the EXTINFO and ROMDIR sections
-  unsigned char *extinfo = img + ( ( nb_entries + 1 ) * sizeof( romdir_t ) );
+  char *extinfo = img + ( ( nb_entries + 1 ) * sizeof( romdir_t ) );
   for ( i = 0; i < nb_entries; i++ ) {
-    //print("%p [%p]\n",extinfo,img);
-    if ( extinfo >= ( unsigned char * ) ( img + img_size ) )
+    if ( extinfo > img + img_size ||
+         romdir[i].extinfo_size > img + img_size - extinfo )
       fatal( "%s is not a valid Playstation 2 ROM image: "
              "EXTINFO section ended prematuraly\n", image_file );
 
@@ -124,41 +110,11 @@ fill_entry_descriptors( char *image_file, char *img, int img_size,
     if ( max_name < strlen( entries[i].name ) )
       max_name = strlen( entries[i].name );
 
-    entries[i].flags = 0;
-    int size = romdir[i].extinfo_size;
-    while ( size ) {
-
-      if ( extinfo >= ( unsigned char * ) ( img + img_size ) )
-        fatal( "%s is not a valid Playstation 2 ROM image: "
-               "EXTINFO section ended prematuraly\n", image_file );
-      extinfo_t *ei = ( extinfo_t * ) extinfo;
-
-      switch ( ei->id ) {
-      case EXTINFO_ID_DATE:
-        entries[i].date = *( unsigned int * ) ( ei + 1 );
-        entries[i].flags |= ENTRY_FLAG_DATE;
-        break;
-      case EXTINFO_ID_VERSION:
-        entries[i].version = ei->value;
-        entries[i].flags |= ENTRY_FLAG_VERSION;
-        break;
-      case EXTINFO_ID_DESCR:
-        strcpy( entries[i].descr, ( char * ) ( ei + 1 ) );
-        entries[i].flags |= ENTRY_FLAG_DESCR;
-        break;
-      case EXTINFO_ID_NULL:
-        strcpy( entries[i].descr, ( char * ) ( ei + 1 ) );
-        entries[i].flags |= ENTRY_FLAG_NULL;
-        break;
-      default:
-        fatal( "%s is not a valid Playstation 2 archive: "
-               "invalid EXTINFO id for IRX %s\n",
-               image_file, entries[i].name );
-      }
-
-      size -= ( sizeof( extinfo_t ) + ei->size );
-      extinfo += ( sizeof( extinfo_t ) + ei->size );
-    }
+    if ( !extinfo_decode( &entries[i], extinfo, romdir[i].extinfo_size ) )
+      fatal( "%s is not a valid Playstation 2 ROM image: "
+             "invalid EXTINFO records for IRX %s\n",
+             image_file, entries[i].name );
+    extinfo += romdir[i].extinfo_size;
   }
 
   // The IRX files are located right after sizeof(ROMDIR) + sizeof(EXTINFO)
@@ -166,8 +122,12 @@ fill_entry_descriptors( char *image_file, char *img, int img_size,
   entries[0].irx_size = romdir[0].size;
   entries[1].irx_size = romdir[1].size;
   entries[2].irx_size = romdir[2].size;
+  entries[0].irx_offset = 0;
+  entries[1].irx_offset = 0;
+  entries[2].irx_offset = romdir[1].size;
   for ( i = 3; i < nb_entries; i++ ) {
-    entries[i].irx_binary = ( char * ) ( elf_offset + ( int ) img );
+    entries[i].irx_binary = img + elf_offset;
+    entries[i].irx_offset = elf_offset;
     entries[i].irx_size = romdir[i].size;
     elf_offset += PAD16( romdir[i].size );
     if ( max_size < romdir[i].size )
@@ -177,6 +137,48 @@ fill_entry_descriptors( char *image_file, char *img, int img_size,
   verbose_set_length_of_name_column( max_name );
   *res_entries = entries;
   *res_nb_entries = nb_entries;
+  TRACE_END( "fill_entry_descriptors" );
+}
+
+
+/*---------------------------------------------------------------------*/
+/*    extract_entry ...                                                */
+/*    -------------------------------------------------------------    */
+/*    Save an IRX to a file. When the IRX is not in memory, it is      */
+/*    read from the image file fd, at the offset given by the index,   */
+/*    and checked against the digest the index recorded for it.        */
+/*---------------------------------------------------------------------*/
+static void extract_entry( char *image_name, int fd, entry_t * e,
+                           const unsigned char *hash )
+{
+  unsigned char digest[SHA256_SIZE];
+  char *irx = e->irx_binary;
+
+  TRACE_BEGIN( "extract_entry", e->name );
+  if ( verbose )
+    verbose_print_extract_message( e->name, e->irx_size );
+
+  if ( irx == NULL ) {
+    if ( ( irx = malloc( e->irx_size ) ) == NULL )
+      fatal_with_errno( "Cannot allocate %d bytes of memory", e->irx_size );
+    if ( pread( fd, irx, e->irx_size, e->irx_offset ) != e->irx_size )
+      fatal_with_errno( "Cannot read entry %s from ROM image %s", e->name,
+                        image_name );
+    sha256_digest( irx, e->irx_size, digest );
+    if ( memcmp( digest, hash, SHA256_SIZE ) != 0 )
+      fatal( "Entry %s of ROM image %s does not match its index",
+             e->name, image_name );
+  } else
+    hash = NULL;
+
+  if ( store_dir )
+    store_entry( e->name, irx, e->irx_size, hash );
+  else
+    write_file( e->name, ( unsigned char * ) irx, e->irx_size );
+
+  if ( irx != e->irx_binary )
+    free( irx );
+  TRACE_END( "extract_entry" );
 }
 
 
@@ -188,15 +190,36 @@ fill_entry_descriptors( char *image_file, char *img, int img_size,
 /*---------------------------------------------------------------------*/
 void extract_image( char *image_name, char *irx_args[], int num_irx )
 {
-  // Read the entire file
-  char *img;
-  int size, i, j;
-  read_file( image_name, &img, &size );
-
-  // Fill our entry descriptors
+  char *img = NULL;
+  int size, i, j, compression;
+  unsigned char *hashes = NULL;
+  int fd;
   entry_t *entry;
   int nb_entries;
-  fill_entry_descriptors( image_name, img, size, &entry, &nb_entries );
+
+  if ( ( fd = open( image_name, O_RDONLY ) ) == -1 )
+    fatal_with_errno( "Cannot open file %s", image_name );
+
+  // The index tells where the IRXs are: only the extracted ones are
+  // read from the opened image, provided the index describes that
+  // very file. A compressed image has to be read whole anyway, and
+  // is parsed from what was read.
+  if ( !index_read( image_name, fd, &entry, &nb_entries, &compression,
+                    &hashes ) || compression != COMPRESS_NONE ) {
+    if ( hashes ) {
+      free( entry );
+      free( hashes );
+      hashes = NULL;
+    }
+    close( fd );
+    fd = -1;
+
+    // Read the entire file
+    read_file( image_name, &img, &size );
+
+    // Fill our entry descriptors
+    fill_entry_descriptors( image_name, img, size, &entry, &nb_entries );
+  }
 
   if ( verbose ) {
     int max_name = 0;
@@ -219,9 +242,8 @@ void extract_image( char *image_name, char *irx_args[], int num_irx )
       int j;
       for ( j = 3; j < nb_entries; j++ ) {
         if ( strcmp( entry[j].name, irx_args[i] ) == 0 ) {
-          if ( verbose )
-            verbose_print_extract_message( entry[j].name, entry[j].irx_size );
-          write_file( entry[j].name, entry[j].irx_binary, entry[j].irx_size );
+          extract_entry( image_name, fd, &entry[j],
+                         hashes ? hashes + j * SHA256_SIZE : NULL );
           break;
         }
       }
@@ -231,12 +253,14 @@ void extract_image( char *image_name, char *irx_args[], int num_irx )
     }
   } else {
     // Extract all IRX to files
-    for ( i = 3; i < nb_entries; i++ ) {
-      if ( verbose )
-        verbose_print_extract_message( entry[i].name, entry[i].irx_size );
-      write_file( entry[i].name, entry[i].irx_binary, entry[i].irx_size );
-    }
+    for ( i = 3; i < nb_entries; i++ )
+      extract_entry( image_name, fd, &entry[i],
+                     hashes ? hashes + i * SHA256_SIZE : NULL );
   }
+
+  if ( fd != -1 )
+    close( fd );
+  free( hashes );
 }
 
 
@@ -247,15 +271,19 @@ void extract_image( char *image_name, char *irx_args[], int num_irx )
 /*---------------------------------------------------------------------*/
 void list_image_entries( char *image_name )
 {
-  // Read the entire file
   char *img;
-  int size, i;
-  read_file( image_name, &img, &size );
-
-  // Fill our entry descriptors
+  int size, i, compression;
   entry_t *entry;
   int nb_entries;
-  fill_entry_descriptors( image_name, img, size, &entry, &nb_entries );
+
+  if ( !index_read( image_name, -1, &entry, &nb_entries, &compression,
+                    NULL ) ) {
+    // Read the entire file
+    read_file( image_name, &img, &size );
+
+    // Fill our entry descriptors
+    fill_entry_descriptors( image_name, img, size, &entry, &nb_entries );
+  }
 
   verbose_display_header(  );
   for ( i = 0; i < nb_entries; i++ ) {
@@ -265,23 +293,15 @@ void list_image_entries( char *image_name )
 
 
 /*---------------------------------------------------------------------*/
-/*    delete_entries_from_image                                        */
+/*    compact_image                                                    */
 /*    -------------------------------------------------------------    */
-/*    Delete some IRXs from an existing image. In-place process.       */
+/*    Remove from an image loaded in memory the entries whose name     */
+/*    starts with -1, moving the kept sections to their new place.     */
+/*    Return the new size of the image.                                */
 /*---------------------------------------------------------------------*/
-void
-delete_entries_from_image( char *image_name, char *irx_args[], int num_irx )
+int compact_image( char *img, entry_t * entry, int nb_entries )
 {
-  // Read the entire file
-  char *img;
-  int size, i, j;
-  read_file( image_name, &img, &size );
-
-  // Fill our entry descriptors
-  entry_t *entry;
-  int nb_entries;
-  fill_entry_descriptors( image_name, img, size, &entry, &nb_entries );
-
+  int i;
   romdir_t *romdir_entry = ( romdir_t * ) img;
 
   int romdir_original = 0;
@@ -299,34 +319,6 @@ delete_entries_from_image( char *image_name, char *irx_args[], int num_irx )
   char *extinfo_section = romdir_section + romdir_entry[1].size;
   char *irx_section = extinfo_section + PAD16( romdir_entry[2].size );
 
-  if ( verbose ) {
-    int max_name = 0;
-    // find out the size of the name column
-    for ( j = 0; j < num_irx; j++ ) {
-      for ( i = 0; i < nb_entries; i++ ) {
-        if ( strcmp( entry[i].name, irx_args[j] ) == 0 ) {
-          if ( max_name < strlen( entry[i].name ) )
-            max_name = strlen( entry[i].name );
-          break;
-        }
-      }
-    }
-    verbose_set_length_of_name_column( max_name );
-  }
-  // mark irx entries to delete
-  for ( j = 0; j < num_irx; j++ ) {
-    for ( i = 0; i < nb_entries; i++ ) {
-      if ( strcmp( entry[i].name, irx_args[j] ) == 0 ) {
-        if ( verbose )
-          verbose_print_delete_message( entry[i].name, entry[i].irx_size );
-        entry[i].name[0] = -1;
-        break;
-      }
-    }
-    if ( i == nb_entries )
-      fatal( "Entry %s not found in ROM image %s", irx_args[j], image_name );
-  }
-
   // Update all section at once
   for ( i = 0; i < nb_entries; i++ ) {
     // pad the previous section with zeros, if any
@@ -385,8 +377,68 @@ delete_entries_from_image( char *image_name, char *irx_args[], int num_irx )
   memmove( img + new_romdir_size + new_extinfo_size, irx_section,
            new_irx_size );
 
+  return new_romdir_size + new_extinfo_size + new_irx_size;
+}
+
+
+/*---------------------------------------------------------------------*/
+/*    delete_entries_from_image                                        */
+/*    -------------------------------------------------------------    */
+/*    Delete some IRXs from an existing image. In-place process.       */
+/*---------------------------------------------------------------------*/
+void
+delete_entries_from_image( char *image_name, char *irx_args[], int num_irx )
+{
+  // Read the entire file
+  char *img;
+  int size, i, j, compression;
+  image_lock( image_name );
+  read_file_compressed( image_name, &img, &size, &compression );
+
+  // Fill our entry descriptors
+  entry_t *entry;
+  int nb_entries;
+  fill_entry_descriptors( image_name, img, size, &entry, &nb_entries );
+
+  if ( verbose ) {
+    int max_name = 0;
+    // find out the size of the name column
+    for ( j = 0; j < num_irx; j++ ) {
+      for ( i = 0; i < nb_entries; i++ ) {
+        if ( strcmp( entry[i].name, irx_args[j] ) == 0 ) {
+          if ( max_name < strlen( entry[i].name ) )
+            max_name = strlen( entry[i].name );
+          break;
+        }
+      }
+    }
+    verbose_set_length_of_name_column( max_name );
+  }
+  // mark irx entries to delete
+  for ( j = 0; j < num_irx; j++ ) {
+    for ( i = 0; i < nb_entries; i++ ) {
+      if ( strcmp( entry[i].name, irx_args[j] ) == 0 ) {
+        if ( verbose )
+          verbose_print_delete_message( entry[i].name, entry[i].irx_size );
+        entry[i].name[0] = -1;
+        break;
+      }
+    }
+    if ( i == nb_entries )
+      fatal( "Entry %s not found in ROM image %s", irx_args[j], image_name );
+  }
+
+  // remove them from the image
+  int new_total_size = compact_image( img, entry, nb_entries );
+
   // done ! save the result to disk
-  write_file( image_name, img,
-              new_romdir_size + new_extinfo_size + new_irx_size );
+  compression = image_compression( image_name, compression );
+  write_file_compressed( image_name, img, new_total_size, compression );
 
+  if ( index_wanted( image_name ) ) {
+    fill_entry_descriptors( image_name, img, new_total_size, &entry,
+                            &nb_entries );
+    index_write( image_name, entry, nb_entries, compression );
+  }
+  image_unlock(  );
 }